@@ -0,0 +1,54 @@
+#include "AdaptiveFrameDepth.h"
+#include <algorithm>
+
+// A frame slot waited for less than this was already free
+static const double IDLE_WAIT_MS = 0.05;
+// Share of the window that must have found its slot free to lower the depth
+static const double IDLE_SHARE = 0.9;
+// CPU times are spiky when the 95th percentile exceeds the median by this
+// factor, and by more than jitter that a deeper queue would not matter for
+static const double SPIKE_RATIO = 1.5;
+static const double SPIKE_MIN_MS = 0.5;
+
+void AdaptiveFrameDepth::init(uint32_t minDepth, uint32_t maxDepth)
+{
+  this->minDepth = minDepth;
+  this->maxDepth = maxDepth;
+  cpuTimes.clear();
+  cpuTimes.reserve(ADAPTIVE_DEPTH_WINDOW);
+  idleFrames = 0;
+  changes = 0;
+}
+
+uint32_t AdaptiveFrameDepth::update(uint32_t depth, double waitMilliseconds,
+                                    double cpuMilliseconds)
+{
+  cpuTimes.push_back(cpuMilliseconds);
+  if (waitMilliseconds < IDLE_WAIT_MS)
+    idleFrames++;
+
+  if (cpuTimes.size() < ADAPTIVE_DEPTH_WINDOW)
+    return depth;
+
+  uint32_t next = depth;
+  if (cpuSpiky())
+    next = std::min(depth + 1, maxDepth);
+  else if (idleFrames >= IDLE_SHARE * ADAPTIVE_DEPTH_WINDOW)
+    next = std::max(depth - 1, minDepth);
+
+  if (next != depth)
+    changes++;
+
+  cpuTimes.clear();
+  idleFrames = 0;
+  return next;
+}
+
+bool AdaptiveFrameDepth::cpuSpiky() const
+{
+  std::vector<double> sorted = cpuTimes;
+  std::sort(sorted.begin(), sorted.end());
+  double median = sorted[sorted.size() / 2];
+  double p95 = sorted[sorted.size() * 95 / 100];
+  return p95 > SPIKE_RATIO * median && p95 - median > SPIKE_MIN_MS;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Number of frames looked at before the adaptive depth changes
+inline const uint32_t ADAPTIVE_DEPTH_WINDOW = 120;
+
+// Picks the number of frames in flight from the way the last frames ran.
+// - When the frame waited for at the start of a frame had nearly always
+//   completed already, the GPU is idle between frames and the extra queued
+//   frame only adds latency: the depth is lowered.
+// - When the CPU time of the frames is spiky (95th percentile well above the
+//   median), a deeper queue keeps the GPU fed through the spikes: the depth
+//   is raised. Raising wins over lowering, so that the two do not take
+//   turns.
+// The depth changes by one at most once per window of frames, and the
+// window starts over after every change.
+class AdaptiveFrameDepth
+{
+public:
+  void init(uint32_t minDepth, uint32_t maxDepth);
+
+  // Report a frame drawn with depth frames in flight, which waited
+  // waitMilliseconds for its frame slot and spent cpuMilliseconds on
+  // everything else. Returns the depth to use from the next frame on.
+  uint32_t update(uint32_t depth, double waitMilliseconds,
+                  double cpuMilliseconds);
+
+  // Number of times update() changed the depth
+  uint32_t changeCount() const { return changes; }
+
+private:
+  uint32_t minDepth = 1;
+  uint32_t maxDepth = 1;
+  std::vector<double> cpuTimes;
+  uint32_t idleFrames = 0;
+  uint32_t changes = 0;
+
+  bool cpuSpiky() const;
+};
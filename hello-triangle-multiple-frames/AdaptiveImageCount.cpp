@@ -0,0 +1,50 @@
+#include "AdaptiveImageCount.h"
+#include <algorithm>
+
+// An acquire that waited longer than this stalled the frame
+static const double ACQUIRE_STALL_MS = 0.5;
+// Share of the window that must have stalled to raise the count, and the
+// share above which the stalls are the display rate rather than a lack of
+// images
+static const double STALL_SHARE = 0.05;
+static const double DISPLAY_BOUND_SHARE = 0.9;
+// Images the queued frames cannot use: the one on screen and the one being
+// rendered to
+static const uint32_t RESERVED_IMAGES = 2;
+
+void AdaptiveImageCount::init(uint32_t minCount, uint32_t maxCount)
+{
+  this->minCount = minCount;
+  this->maxCount = std::max(minCount, maxCount);
+  frames = 0;
+  stalledFrames = 0;
+  maxQueuedFrames = 0;
+  changes = 0;
+}
+
+uint32_t AdaptiveImageCount::update(uint32_t count, double acquireMilliseconds,
+                                    uint32_t queuedFrames)
+{
+  frames++;
+  if (acquireMilliseconds > ACQUIRE_STALL_MS)
+    stalledFrames++;
+  maxQueuedFrames = std::max(maxQueuedFrames, queuedFrames);
+
+  if (frames < ADAPTIVE_IMAGES_WINDOW)
+    return count;
+
+  uint32_t next = count;
+  if (stalledFrames >= STALL_SHARE * ADAPTIVE_IMAGES_WINDOW &&
+      stalledFrames < DISPLAY_BOUND_SHARE * ADAPTIVE_IMAGES_WINDOW)
+    next = std::min(count + 1, maxCount);
+  else if (maxQueuedFrames + RESERVED_IMAGES < count)
+    next = std::max(count - 1, minCount);
+
+  if (next != count)
+    changes++;
+
+  frames = 0;
+  stalledFrames = 0;
+  maxQueuedFrames = 0;
+  return next;
+}
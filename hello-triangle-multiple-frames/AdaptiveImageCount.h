@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+
+// Number of frames looked at before the adaptive image count changes
+inline const uint32_t ADAPTIVE_IMAGES_WINDOW = 120;
+
+// Picks the number of swap chain images from the way the last frames
+// acquired theirs.
+// - When acquiring blocked in some frames but not in most of them, the
+//   presentation engine held every image only now and then, after a slow
+//   frame: one more image absorbs these stalls and the count is raised.
+// - When nearly every acquire blocked, the frame rate is bound by the
+//   display and not by a lack of images: another image would only queue one
+//   more frame in front of the screen, so the count is not raised.
+// - Otherwise, when no frame found more frames queued for presentation than
+//   the count leaves room for, the last image is never needed and only adds
+//   latency: the count is lowered.
+// The count changes by one at most once per window of frames, and the
+// window starts over after every change.
+class AdaptiveImageCount
+{
+public:
+  void init(uint32_t minCount, uint32_t maxCount);
+
+  // Report a frame that waited acquireMilliseconds for its image while
+  // queuedFrames earlier frames were still waiting to be rendered and
+  // presented. Returns the image count to use from the next frame on.
+  uint32_t update(uint32_t count, double acquireMilliseconds,
+                  uint32_t queuedFrames);
+
+  // Number of times update() changed the count
+  uint32_t changeCount() const { return changes; }
+
+private:
+  uint32_t minCount = 2;
+  uint32_t maxCount = 2;
+  uint32_t frames = 0;
+  uint32_t stalledFrames = 0;
+  uint32_t maxQueuedFrames = 0;
+  uint32_t changes = 0;
+};
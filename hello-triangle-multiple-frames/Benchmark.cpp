@@ -0,0 +1,160 @@
+#include "Benchmark.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+
+static std::string jsonString(const std::string &value)
+{
+  std::ostringstream out;
+  out << '"';
+  for (char c : value)
+  {
+    if (c == '"' || c == '\\')
+      out << '\\' << c;
+    else if (static_cast<unsigned char>(c) < 0x20)
+      out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+          << static_cast<int>(c) << std::dec;
+    else
+      out << c;
+  }
+  out << '"';
+  return out.str();
+}
+
+// Nearest-rank percentile of an ascending list of samples
+static double percentile(const std::vector<double> &sorted, double p)
+{
+  size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+  return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+void Benchmark::beginFrame()
+{
+  if (!enabled)
+    return;
+
+  frameIndex++;
+  frameStart = Clock::now();
+  if (frameCount == 0)
+    measureStart = frameStart;
+}
+
+void Benchmark::endFrame()
+{
+  if (!measuring())
+    return;
+
+  measureEnd = Clock::now();
+  samples("frame_cpu_ms")
+      .push_back(std::chrono::duration<double, std::milli>(measureEnd -
+                                                            frameStart)
+                     .count());
+  frameCount++;
+}
+
+void Benchmark::addSample(const std::string &metric, double milliseconds)
+{
+  if (measuring())
+    samples(metric).push_back(milliseconds);
+}
+
+void Benchmark::setInfo(const std::string &key, const std::string &value)
+{
+  info.emplace_back(key, jsonString(value));
+}
+
+void Benchmark::setInfo(const std::string &key, double value)
+{
+  std::ostringstream literal;
+  literal << std::setprecision(15) << value;
+  info.emplace_back(key, literal.str());
+}
+
+size_t Benchmark::count(const std::string &metric) const
+{
+  const std::vector<double> *values = find(metric);
+  return values ? values->size() : 0;
+}
+
+double Benchmark::mean(const std::string &metric) const
+{
+  const std::vector<double> *values = find(metric);
+  if (!values || values->empty())
+    return 0.0;
+
+  return std::accumulate(values->begin(), values->end(), 0.0) /
+         values->size();
+}
+
+const std::vector<double> *Benchmark::find(const std::string &metric) const
+{
+  for (const auto &[name, values] : metrics)
+    if (name == metric)
+      return &values;
+
+  return nullptr;
+}
+
+std::vector<double> &Benchmark::samples(const std::string &metric)
+{
+  for (auto &[name, values] : metrics)
+    if (name == metric)
+      return values;
+
+  metrics.emplace_back(metric, std::vector<double>{});
+  return metrics.back().second;
+}
+
+void Benchmark::writeJson(std::ostream &out) const
+{
+  double seconds =
+      std::chrono::duration<double>(measureEnd - measureStart).count();
+
+  out << std::fixed << std::setprecision(4);
+  out << "{\n";
+  out << "  \"frames\": " << frameCount << ",\n";
+  out << "  \"warmup_frames\": " << BENCHMARK_WARMUP_FRAMES << ",\n";
+  out << "  \"seconds\": " << seconds << ",\n";
+  out << "  \"fps\": " << (seconds > 0.0 ? frameCount / seconds : 0.0)
+      << ",\n";
+  for (const auto &[key, value] : info)
+    out << "  " << jsonString(key) << ": " << value << ",\n";
+
+  out << "  \"metrics\": {";
+  for (size_t i = 0; i < metrics.size(); i++)
+  {
+    std::vector<double> sorted = metrics[i].second;
+    std::sort(sorted.begin(), sorted.end());
+
+    out << (i == 0 ? "\n" : ",\n");
+    out << "    " << jsonString(metrics[i].first) << ": {";
+    out << "\"count\": " << sorted.size();
+    if (!sorted.empty())
+    {
+      double mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) /
+                    sorted.size();
+      out << ", \"mean\": " << mean;
+      out << ", \"p50\": " << percentile(sorted, 50.0);
+      out << ", \"p95\": " << percentile(sorted, 95.0);
+      out << ", \"p99\": " << percentile(sorted, 99.0);
+      out << ", \"max\": " << sorted.back();
+    }
+    out << "}";
+  }
+  out << "\n  }\n";
+  out << "}\n";
+}
+
+void Benchmark::writeJson(const std::string &filename) const
+{
+  std::ofstream file(filename);
+
+  if (!file.is_open())
+    throw std::runtime_error("failed to open benchmark output file!");
+
+  writeJson(file);
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Number of frames at the start of a benchmark run that are not measured.
+// The first frames pay for lazy driver work (shader compilation, memory
+// residency, swap chain creation) and would distort the percentiles.
+inline const uint32_t BENCHMARK_WARMUP_FRAMES = 10;
+
+// Collects per-frame CPU timings and writes them as JSON.
+// Every metric is a list of samples in milliseconds. The report contains the
+// mean, the 50th, 95th and 99th percentile and the maximum of every metric.
+// A disabled benchmark does not read the clock at all, so the timers can stay
+// in the frame loop of regular runs.
+class Benchmark
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // Measures the time between its construction and destruction and adds it
+  // to a metric.
+  class ScopedTimer
+  {
+  public:
+    explicit ScopedTimer(std::vector<double> *samples)
+        : samples(samples), start(samples ? Clock::now() : Clock::time_point{})
+    {
+    }
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+    ~ScopedTimer()
+    {
+      if (samples)
+        samples->push_back(
+            std::chrono::duration<double, std::milli>(Clock::now() - start)
+                .count());
+    }
+
+  private:
+    std::vector<double> *samples;
+    Clock::time_point start;
+  };
+
+  bool enabled = false;
+
+  // Mark the start and the end of a frame. The time in between is recorded
+  // as "frame_cpu_ms". Samples taken during warm-up frames are dropped.
+  void beginFrame();
+  void endFrame();
+
+  // Time the enclosing scope and add it to metric.
+  ScopedTimer time(const std::string &metric)
+  {
+    return ScopedTimer(measuring() ? &samples(metric) : nullptr);
+  }
+
+  // Add a sample that was measured elsewhere, e.g. on the GPU.
+  void addSample(const std::string &metric, double milliseconds);
+
+  // Add a value that describes the run, e.g. the device name.
+  void setInfo(const std::string &key, const std::string &value);
+  void setInfo(const std::string &key, double value);
+
+  uint32_t measuredFrames() const { return frameCount; }
+
+  // Number of samples and mean of a metric, 0 for unknown metrics.
+  size_t count(const std::string &metric) const;
+  double mean(const std::string &metric) const;
+
+  void writeJson(std::ostream &out) const;
+  void writeJson(const std::string &filename) const;
+
+private:
+  uint32_t frameIndex = 0;
+  uint32_t frameCount = 0;
+  Clock::time_point frameStart;
+  Clock::time_point measureStart;
+  Clock::time_point measureEnd;
+  // Metrics in the order in which they were first recorded
+  std::vector<std::pair<std::string, std::vector<double>>> metrics;
+  // Values are stored as JSON literals
+  std::vector<std::pair<std::string, std::string>> info;
+
+  bool measuring() const
+  {
+    return enabled && frameIndex > BENCHMARK_WARMUP_FRAMES;
+  }
+  std::vector<double> &samples(const std::string &metric);
+  const std::vector<double> *find(const std::string &metric) const;
+};
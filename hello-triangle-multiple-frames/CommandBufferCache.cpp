@@ -0,0 +1,92 @@
+#include "CommandBufferCache.h"
+#include <stdexcept>
+
+void CommandBufferCache::init(VkDevice device, VkCommandPool commandPool,
+                              uint32_t frameCount, uint32_t imageCount)
+{
+  this->device = device;
+  this->commandPool = commandPool;
+  this->frameCount = frameCount;
+  this->imageCount = imageCount;
+  entries.assign(frameCount * imageCount, Entry{});
+  spare.assign(frameCount, {});
+}
+
+void CommandBufferCache::destroy()
+{
+  freeCommandBuffers();
+  entries.clear();
+  spare.clear();
+}
+
+VkCommandBuffer CommandBufferCache::get(uint32_t frame, uint32_t image,
+                                        uint64_t sceneVersion, bool &upToDate)
+{
+  Entry &entry = entries[frame * imageCount + image];
+
+  if (entry.commandBuffer == VK_NULL_HANDLE && !spare[frame].empty())
+  {
+    entry.commandBuffer = spare[frame].back();
+    spare[frame].pop_back();
+  }
+  else if (entry.commandBuffer == VK_NULL_HANDLE)
+  {
+    VkCommandBufferAllocateInfo allocInfo{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = nullptr,
+        .commandPool = commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+
+    if (vkAllocateCommandBuffers(device, &allocInfo, &entry.commandBuffer) !=
+        VK_SUCCESS)
+      throw std::runtime_error("failed to allocate command buffers!");
+  }
+
+  upToDate = entry.recorded && entry.sceneVersion == sceneVersion;
+  if (upToDate)
+  {
+    reuses++;
+    return entry.commandBuffer;
+  }
+
+  entry.sceneVersion = sceneVersion;
+  entry.recorded = true;
+  records++;
+  return entry.commandBuffer;
+}
+
+void CommandBufferCache::invalidate(uint32_t imageCount)
+{
+  if (imageCount == this->imageCount)
+  {
+    for (auto &entry : entries)
+      entry.recorded = false;
+    return;
+  }
+
+  for (uint32_t frame = 0; frame < frameCount; frame++)
+    for (uint32_t image = 0; image < this->imageCount; image++)
+    {
+      VkCommandBuffer commandBuffer =
+          entries[frame * this->imageCount + image].commandBuffer;
+      if (commandBuffer != VK_NULL_HANDLE)
+        spare[frame].push_back(commandBuffer);
+    }
+
+  this->imageCount = imageCount;
+  entries.assign(frameCount * imageCount, Entry{});
+}
+
+void CommandBufferCache::freeCommandBuffers()
+{
+  for (auto &entry : entries)
+    if (entry.commandBuffer != VK_NULL_HANDLE)
+      vkFreeCommandBuffers(device, commandPool, 1, &entry.commandBuffer);
+  for (auto &commandBuffers : spare)
+    if (!commandBuffers.empty())
+      vkFreeCommandBuffers(device, commandPool,
+                           static_cast<uint32_t>(commandBuffers.size()),
+                           commandBuffers.data());
+}
@@ -0,0 +1,60 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <vector>
+
+// Primary command buffers recorded for a (frame slot, swap chain image, scene
+// version) key.
+// The commands of a frame only depend on the image it renders to, on the
+// per-slot resources it uses (e.g. the timestamp query pool) and on the
+// scene, so a command buffer recorded for the same key can be submitted again
+// as it is instead of being recorded every frame.
+// A command buffer is only handed out again once the previous frame of its
+// slot has completed, so it is never pending when it is reused or reset.
+class CommandBufferCache
+{
+public:
+  void init(VkDevice device, VkCommandPool commandPool, uint32_t frameCount,
+            uint32_t imageCount);
+  void destroy();
+
+  // Return the command buffer of frame slot and image.
+  // When it was last recorded for another scene version, or never, upToDate
+  // is false: the caller must record it before submitting it, which resets
+  // it (the command pool must allow resetting single command buffers).
+  // Otherwise it still holds the commands recorded for sceneVersion.
+  VkCommandBuffer get(uint32_t frame, uint32_t image, uint64_t sceneVersion,
+                      bool &upToDate);
+
+  // Drop every recording, e.g. after the swap chain images, framebuffers or
+  // pipelines they refer to have been recreated. The command buffers may
+  // still be pending: they stay with their frame slot and are only recorded
+  // again once the slot's frame has completed.
+  void invalidate(uint32_t imageCount);
+
+  // Number of command buffers recorded and reused since init()
+  uint64_t recordCount() const { return records; }
+  uint64_t reuseCount() const { return reuses; }
+
+private:
+  struct Entry
+  {
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    uint64_t sceneVersion = 0;
+    bool recorded = false;
+  };
+
+  VkDevice device = VK_NULL_HANDLE;
+  VkCommandPool commandPool = VK_NULL_HANDLE;
+  uint32_t frameCount = 0;
+  uint32_t imageCount = 0;
+  // Indexed by frame * imageCount + image, allocated on first use
+  std::vector<Entry> entries;
+  // Command buffers of every frame slot left over by invalidate() after the
+  // image count changed, used before allocating new ones
+  std::vector<std::vector<VkCommandBuffer>> spare;
+  uint64_t records = 0;
+  uint64_t reuses = 0;
+
+  void freeCommandBuffers();
+};
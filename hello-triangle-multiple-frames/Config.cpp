@@ -0,0 +1,160 @@
+#include "Config.h"
+#include "Benchmark.h"
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+static const char *nextValue(int argc, char **argv, int &i)
+{
+  if (i + 1 >= argc)
+    throw std::runtime_error(std::string("missing value for ") + argv[i]);
+
+  return argv[++i];
+}
+
+// std::stoul also accepts a sign and wraps negative values around, so the
+// value must start with a digit
+static uint32_t parseCount(const std::string &option, const char *value)
+{
+  try
+  {
+    size_t parsed = 0;
+    unsigned long count = std::stoul(value, &parsed);
+    if (std::isdigit(static_cast<unsigned char>(value[0])) &&
+        parsed == std::string(value).size() &&
+        count <= std::numeric_limits<uint32_t>::max())
+      return static_cast<uint32_t>(count);
+  }
+  catch (const std::exception &)
+  {
+  }
+
+  throw std::runtime_error("invalid value for " + option + ": " + value);
+}
+
+static float parseScale(const std::string &option, const char *value)
+{
+  try
+  {
+    size_t parsed = 0;
+    float scale = std::stof(value, &parsed);
+    if (parsed == std::string(value).size() && scale > 0.0f)
+      return scale;
+  }
+  catch (const std::exception &)
+  {
+  }
+
+  throw std::runtime_error("invalid value for " + option + ": " + value);
+}
+
+AppConfig parseArguments(int argc, char **argv)
+{
+  AppConfig config;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+
+    if (arg == "--headless")
+      config.headless = true;
+    else if (arg == "--frames")
+      config.frameCount = parseCount(arg, nextValue(argc, argv, i));
+    else if (arg == "--screenshot")
+      config.screenshotPath = nextValue(argc, argv, i);
+    else if (arg == "--bench")
+      config.benchmarkFrames = parseCount(arg, nextValue(argc, argv, i));
+    else if (arg == "--bench-output")
+      config.benchmarkOutputPath = nextValue(argc, argv, i);
+    else if (arg == "--pipeline-cache")
+      config.pipelineCachePath = nextValue(argc, argv, i);
+    else if (arg == "--no-pipeline-cache")
+      config.pipelineCachePath.clear();
+    else if (arg == "--no-command-reuse")
+      config.reuseCommandBuffers = false;
+    else if (arg == "--draws")
+      config.drawCount = parseCount(arg, nextValue(argc, argv, i));
+    else if (arg == "--record-threads")
+    {
+      // The draws are recorded on the workers of the application's thread
+      // pool, more threads than workers would only wait for each other
+      const char *value = nextValue(argc, argv, i);
+      config.recordThreads = parseCount(arg, value);
+      if (config.recordThreads >
+          std::max(1u, std::thread::hardware_concurrency()))
+        throw std::runtime_error("invalid value for " + arg + ": " + value);
+    }
+    else if (arg == "--frames-in-flight")
+    {
+      std::string value = nextValue(argc, argv, i);
+      config.adaptiveFramesInFlight = value == "auto";
+      if (!config.adaptiveFramesInFlight)
+        config.framesInFlight = parseCount(arg, value.c_str());
+    }
+    else if (arg == "--bench-depths")
+      config.benchmarkDepthSweep = true;
+    else if (arg == "--binary-sync")
+      config.timelineSemaphores = false;
+    else if (arg == "--present")
+      config.presentProfile = parsePresentProfile(nextValue(argc, argv, i));
+    else if (arg == "--frame-cap")
+      config.frameCap = parseCount(arg, nextValue(argc, argv, i));
+    else if (arg == "--bench-profiles")
+      config.benchmarkProfileSweep = true;
+    else if (arg == "--swapchain-images")
+    {
+      std::string value = nextValue(argc, argv, i);
+      config.adaptiveSwapchainImages = value == "auto";
+      if (!config.adaptiveSwapchainImages)
+        config.swapchainImages = parseCount(arg, value.c_str());
+    }
+    else if (arg == "--render-pass")
+      config.dynamicRendering = false;
+    else if (arg == "--instances")
+      config.instanceCount = parseCount(arg, nextValue(argc, argv, i));
+    else if (arg == "--indirect")
+      config.indirectDraws = true;
+    else if (arg == "--gpu-culling")
+      config.gpuCulling = true;
+    else if (arg == "--scene-extent")
+      config.sceneExtent = parseScale(arg, nextValue(argc, argv, i));
+    else if (arg == "--vertex-format")
+      config.vertexFormat = parseVertexFormat(nextValue(argc, argv, i));
+    else
+      throw std::runtime_error("unknown argument: " + arg);
+  }
+
+  if (config.benchmarkFrames > 0)
+    config.frameCount = config.benchmarkFrames + BENCHMARK_WARMUP_FRAMES;
+
+  if (config.headless && config.frameCount == 0)
+    config.frameCount = DEFAULT_HEADLESS_FRAMES;
+
+  if (config.framesInFlight < MIN_FRAMES_IN_FLIGHT ||
+      config.framesInFlight > MAX_FRAMES_IN_FLIGHT)
+    throw std::runtime_error("--frames-in-flight must be between 1 and 4");
+
+  if (config.benchmarkDepthSweep &&
+      (config.benchmarkFrames == 0 || config.adaptiveFramesInFlight))
+    throw std::runtime_error(
+        "--bench-depths needs --bench and no --frames-in-flight auto");
+
+  if (config.benchmarkProfileSweep &&
+      (config.benchmarkFrames == 0 || config.benchmarkDepthSweep))
+    throw std::runtime_error(
+        "--bench-profiles needs --bench and no --bench-depths");
+
+  if (config.drawCount == 0)
+    throw std::runtime_error("--draws must be at least 1");
+
+  // The culling pass writes the indirect draws
+  if (config.gpuCulling)
+    config.indirectDraws = true;
+
+  if (!config.headless && !config.screenshotPath.empty())
+    throw std::runtime_error("--screenshot is only supported with --headless");
+
+  return config;
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include "PresentProfile.h"
+#include "VertexFormat.h"
+#include <cstdint>
+#include <string>
+
+// Number of frames rendered by a headless run when --frames is not given.
+// Without a window there is nothing that would end the main loop otherwise.
+inline const uint32_t DEFAULT_HEADLESS_FRAMES = 600;
+
+// Range of the number of frames in flight. Per-frame resources are created
+// for the maximum, the runtime depth chooses how many of them are used.
+inline const uint32_t MIN_FRAMES_IN_FLIGHT = 1;
+inline const uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+
+// Runtime options of the application.
+// The options are read from the command line by parseArguments() and passed
+// to the HelloTriangleApplication constructor.
+struct AppConfig
+{
+  // Render into device-owned images instead of the images of a window swap
+  // chain. No GLFW window, surface or swap chain is created, so the
+  // application can run on machines without a display (e.g. CI boxes that
+  // only have a software driver like lavapipe).
+  bool headless = false;
+
+  // Number of frames to draw before leaving the main loop.
+  // 0 means "until the window is closed".
+  uint32_t frameCount = 0;
+
+  // When not empty, the last frame rendered in headless mode is read back and
+  // written to this path as a binary PPM image.
+  std::string screenshotPath;
+
+  // Number of frames measured by the frame benchmark, 0 disables it.
+  // The benchmark also draws a few warm-up frames that are not measured.
+  uint32_t benchmarkFrames = 0;
+
+  // File the benchmark results are written to, as JSON.
+  std::string benchmarkOutputPath = "bench.json";
+
+  // File the pipeline cache is loaded from at startup and saved to at
+  // shutdown. Empty to start from an empty cache and not save it.
+  std::string pipelineCachePath = "pipeline_cache.bin";
+
+  // Submit the command buffer recorded for the same frame slot, swap chain
+  // image and scene version again instead of recording it every frame.
+  bool reuseCommandBuffers = true;
+
+  // Number of indexed draws of the mesh in every frame. Larger values make
+  // the recording cost measurable.
+  uint32_t drawCount = 1;
+
+  // Number of threads recording the draws into secondary command buffers,
+  // 0 to record them inline in the primary command buffer. At most the
+  // number of hardware threads.
+  uint32_t recordThreads = 0;
+
+  // Number of frames the CPU may prepare while the GPU is still working on
+  // earlier ones, from MIN_FRAMES_IN_FLIGHT to MAX_FRAMES_IN_FLIGHT. More
+  // frames smooth out CPU spikes, fewer frames reduce the input latency.
+  uint32_t framesInFlight = 2;
+
+  // Let AdaptiveFrameDepth change framesInFlight while running.
+  bool adaptiveFramesInFlight = false;
+
+  // Split the measured frames of the benchmark evenly between every depth
+  // from MIN_FRAMES_IN_FLIGHT to MAX_FRAMES_IN_FLIGHT.
+  bool benchmarkDepthSweep = false;
+
+  // Track the completion of frames and uploads with one timeline semaphore
+  // per queue when the device supports them (Vulkan 1.2), instead of a fence
+  // per submission.
+  bool timelineSemaphores = true;
+
+  // Present mode policy of the swap chain, can be changed while running.
+  PresentProfile presentProfile = PresentProfile::LowestLatency;
+
+  // Upper limit of the frame rate, 0 for none. The power-saving profile
+  // defaults to POWER_SAVING_FRAME_CAP.
+  uint32_t frameCap = 0;
+
+  // Split the measured frames of the benchmark evenly between the present
+  // profiles.
+  bool benchmarkProfileSweep = false;
+
+  // Number of swap chain images, clamped to what the surface supports. 0
+  // for one more than the minimum of the surface.
+  uint32_t swapchainImages = 0;
+
+  // Let AdaptiveImageCount change the number of swap chain images while
+  // running.
+  bool adaptiveSwapchainImages = false;
+
+  // Render without a render pass and framebuffers when the device supports
+  // dynamic rendering (Vulkan 1.3).
+  bool dynamicRendering = true;
+
+  // Draw the quad this many times with one instanced draw per draw call,
+  // 0 to draw it once per draw call without instance data. The transform
+  // and the color of every instance are streamed to the GPU every frame.
+  uint32_t instanceCount = 0;
+
+  // Read the draws from a buffer of VkDrawIndexedIndirectCommand written at
+  // startup, so that recording costs the same for any number of draws.
+  bool indirectDraws = false;
+
+  // Let a compute pass test the bounds of every draw against the view and
+  // keep only the visible draws. Implies indirectDraws.
+  bool gpuCulling = false;
+
+  // Half the size of the grid of instances in clip space. Above 1 the grid
+  // runs off the screen, which gives the culling pass something to cull.
+  float sceneExtent = 1.0f;
+
+  // Encoding of the vertices in the geometry pool. The packed formats take
+  // 8 bytes per vertex instead of 20.
+  VertexFormat vertexFormat = VertexFormat::Float;
+};
+
+// Parse the command line arguments.
+// Supported arguments:
+//   --headless              render offscreen, without a window
+//   --frames <n>            stop after n frames
+//   --screenshot <path>     save the last headless frame as a PPM image
+//   --bench <n>             measure n frames and write the timings as JSON
+//   --bench-output <path>   file the benchmark results are written to
+//   --pipeline-cache <path> file the pipeline cache is kept in
+//   --no-pipeline-cache     compile every pipeline from scratch
+//   --no-command-reuse      record the command buffer of every frame
+//   --draws <n>             draw the mesh n times per frame
+//   --record-threads <n>    record the draws on n threads
+//   --frames-in-flight <n>  queue up to n frames (1 to 4), or "auto"
+//   --bench-depths          benchmark every frames in flight depth
+//   --binary-sync           use fences even if timeline semaphores exist
+//   --present <profile>     lowest-latency, vsync, tear-tolerant or
+//                           power-saving
+//   --frame-cap <fps>       limit the frame rate
+//   --bench-profiles        benchmark every present profile
+//   --swapchain-images <n>  ask for n swap chain images, or "auto"
+//   --render-pass           use a render pass even if dynamic rendering exists
+//   --instances <n>         draw n instances of the quad, updated every frame
+//   --indirect              issue the draws from an indirect buffer
+//   --gpu-culling           cull the draws on the GPU, implies --indirect
+//   --scene-extent <s>      spread the instances over [-s, s] in clip space
+//   --vertex-format <f>     float, snorm16 or half
+// Throws std::runtime_error on unknown or malformed arguments.
+AppConfig parseArguments(int argc, char **argv);
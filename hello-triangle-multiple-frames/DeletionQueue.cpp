@@ -0,0 +1,123 @@
+#include "DeletionQueue.h"
+#include <stdexcept>
+
+// Handles are pointers on 64-bit platforms and uint64_t on the others
+template <typename Handle> static uint64_t toInteger(Handle handle)
+{
+  return (uint64_t)handle;
+}
+
+template <typename Handle> static Handle fromInteger(uint64_t handle)
+{
+  return (Handle)handle;
+}
+
+void DeletionQueue::init(VkDevice device, MemoryAllocator &allocator,
+                         SubmissionTracker &submissions)
+{
+  this->device = device;
+  this->allocator = &allocator;
+  this->submissions = &submissions;
+}
+
+void DeletionQueue::enqueue(VkBuffer buffer, const Allocation &allocation,
+                            uint64_t serial)
+{
+  push(Kind::Buffer, toInteger(buffer), serial, allocation);
+}
+
+void DeletionQueue::enqueue(VkImage image, const Allocation &allocation,
+                            uint64_t serial)
+{
+  push(Kind::Image, toInteger(image), serial, allocation);
+}
+
+void DeletionQueue::enqueue(VkDeviceMemory memory, uint64_t serial)
+{
+  push(Kind::Memory, toInteger(memory), serial);
+}
+
+void DeletionQueue::enqueue(VkImageView imageView, uint64_t serial)
+{
+  push(Kind::ImageView, toInteger(imageView), serial);
+}
+
+void DeletionQueue::enqueue(VkFramebuffer framebuffer, uint64_t serial)
+{
+  push(Kind::Framebuffer, toInteger(framebuffer), serial);
+}
+
+void DeletionQueue::enqueue(VkPipeline pipeline, uint64_t serial)
+{
+  push(Kind::Pipeline, toInteger(pipeline), serial);
+}
+
+void DeletionQueue::enqueue(VkSwapchainKHR swapChain, uint64_t serial)
+{
+  push(Kind::Swapchain, toInteger(swapChain), serial);
+}
+
+void DeletionQueue::collect()
+{
+  // The tracker only queries the GPU for serials past the last completion
+  // it saw, so the objects of an already completed serial cost a comparison
+  while (!pending.empty() && submissions->completed(pending.front().serial))
+  {
+    destroy(pending.front());
+    pending.pop_front();
+  }
+}
+
+void DeletionQueue::flush()
+{
+  for (auto &entry : pending)
+    destroy(entry);
+  pending.clear();
+}
+
+void DeletionQueue::push(Kind kind, uint64_t handle, uint64_t serial,
+                         const Allocation &allocation)
+{
+  if (!pending.empty() && serial < pending.back().serial)
+    throw std::runtime_error("deletion enqueued with an older serial!");
+
+  pending.push_back({
+      .serial = serial,
+      .kind = kind,
+      .handle = handle,
+      .allocation = allocation,
+  });
+}
+
+void DeletionQueue::destroy(Entry &entry)
+{
+  switch (entry.kind)
+  {
+  case Kind::Buffer:
+    vkDestroyBuffer(device, fromInteger<VkBuffer>(entry.handle), nullptr);
+    allocator->free(entry.allocation);
+    break;
+  case Kind::Image:
+    vkDestroyImage(device, fromInteger<VkImage>(entry.handle), nullptr);
+    allocator->free(entry.allocation);
+    break;
+  case Kind::Memory:
+    vkFreeMemory(device, fromInteger<VkDeviceMemory>(entry.handle), nullptr);
+    break;
+  case Kind::ImageView:
+    vkDestroyImageView(device, fromInteger<VkImageView>(entry.handle),
+                       nullptr);
+    break;
+  case Kind::Framebuffer:
+    vkDestroyFramebuffer(device, fromInteger<VkFramebuffer>(entry.handle),
+                         nullptr);
+    break;
+  case Kind::Pipeline:
+    vkDestroyPipeline(device, fromInteger<VkPipeline>(entry.handle), nullptr);
+    break;
+  case Kind::Swapchain:
+    vkDestroySwapchainKHR(device, fromInteger<VkSwapchainKHR>(entry.handle),
+                          nullptr);
+    break;
+  }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include "MemoryAllocator.h"
+#include "SubmissionTracker.h"
+#include <GLFW/glfw3.h>
+#include <cstdint>
+#include <deque>
+
+// Destroys Vulkan objects once the GPU is done with them.
+// Objects replaced while rendering (e.g. the framebuffers of an old swap
+// chain) may still be used by the frames in flight. Instead of waiting for
+// the device to be idle, they are enqueued with the serial of the last
+// submission that used them and destroyed by collect() once that serial has
+// completed on the tracked queue. Objects with the same or an older serial
+// are destroyed together, in the order they were enqueued, so an object is
+// always destroyed before the objects enqueued after it (e.g. image views
+// before their swap chain).
+class DeletionQueue
+{
+public:
+  void init(VkDevice device, MemoryAllocator &allocator,
+            SubmissionTracker &submissions);
+
+  // Destroy the object once the submission with serial has completed.
+  // Memory of the allocator is given back together with its resource.
+  void enqueue(VkBuffer buffer, const Allocation &allocation, uint64_t serial);
+  void enqueue(VkImage image, const Allocation &allocation, uint64_t serial);
+  void enqueue(VkDeviceMemory memory, uint64_t serial);
+  void enqueue(VkImageView imageView, uint64_t serial);
+  void enqueue(VkFramebuffer framebuffer, uint64_t serial);
+  void enqueue(VkPipeline pipeline, uint64_t serial);
+  void enqueue(VkSwapchainKHR swapChain, uint64_t serial);
+
+  // Destroy the objects whose serial has completed
+  void collect();
+  // Destroy every object. The device must be idle.
+  void flush();
+
+  size_t size() const { return pending.size(); }
+
+private:
+  enum class Kind
+  {
+    Buffer,
+    Image,
+    Memory,
+    ImageView,
+    Framebuffer,
+    Pipeline,
+    Swapchain,
+  };
+
+  // Non-dispatchable handles are 64-bit on every platform
+  struct Entry
+  {
+    uint64_t serial;
+    Kind kind;
+    uint64_t handle;
+    Allocation allocation;
+  };
+
+  VkDevice device = VK_NULL_HANDLE;
+  MemoryAllocator *allocator = nullptr;
+  SubmissionTracker *submissions = nullptr;
+  // Ordered by serial, as serials only grow
+  std::deque<Entry> pending;
+
+  void push(Kind kind, uint64_t handle, uint64_t serial,
+            const Allocation &allocation = Allocation{});
+  void destroy(Entry &entry);
+};
@@ -1,6 +1,7 @@
 #include "DeviceUtils.h"
 #include "DebugUtils.h"
 #include <algorithm>
+#include <cstring>
 #include <limits>
 #include <set>
 
@@ -23,12 +24,33 @@ bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
   return requiredExtensions.empty();
 }
 
-std::vector<const char *> getRequiredExtensions() {
-  uint32_t glfwExtensionCount = 0;
-  const char **glfwExtensions =
-      glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-  std::vector<const char *> extensions(glfwExtensions,
-                                       glfwExtensions + glfwExtensionCount);
+bool isDeviceExtensionSupported(VkPhysicalDevice device,
+                                const char *extension) {
+  uint32_t extensionCount;
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+                                       nullptr);
+
+  std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+                                       availableExtensions.data());
+
+  for (const auto &available : availableExtensions) {
+    if (strcmp(available.extensionName, extension) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+std::vector<const char *> getRequiredExtensions(bool headless) {
+  std::vector<const char *> extensions;
+
+  if (!headless) {
+    uint32_t glfwExtensionCount = 0;
+    const char **glfwExtensions =
+        glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  }
 
   if (enableValidationLayers) {
     extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -62,6 +84,9 @@ uint32_t rateDeviceSuitability(VkPhysicalDevice device, VkSurfaceKHR surface) {
     score += 1000;
 
   score += deviceProperties.limits.maxImageDimension2D;
+  if (surface == VK_NULL_HANDLE)
+    return score;
+
   auto swapChainSupport = querySwapChainSupport(device, surface);
 
   if (checkDeviceExtensionSupport(device))
@@ -111,16 +136,32 @@ VkSurfaceFormatKHR chooseSwapSurfaceFormat(
 }
 
 VkPresentModeKHR chooseSwapPresentMode(
-    const std::vector<VkPresentModeKHR> &availablePresentModes) {
-  for (const auto &availablePresentMode : availablePresentModes) {
-    if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-      return availablePresentMode;
+    const std::vector<VkPresentModeKHR> &availablePresentModes,
+    PresentProfile profile) {
+  for (auto presentMode : preferredPresentModes(profile)) {
+    if (std::find(availablePresentModes.begin(), availablePresentModes.end(),
+                  presentMode) != availablePresentModes.end()) {
+      return presentMode;
     }
   }
 
   return VK_PRESENT_MODE_FIFO_KHR;
 }
 
+uint32_t chooseSwapImageCount(const VkSurfaceCapabilitiesKHR &capabilities,
+                              uint32_t requested) {
+  uint32_t maxImageCount = capabilities.maxImageCount;
+  if (maxImageCount == 0) {
+    maxImageCount = capabilities.minImageCount + MAX_EXTRA_SWAPCHAIN_IMAGES;
+  }
+
+  if (requested == 0) {
+    requested = capabilities.minImageCount + 1;
+  }
+
+  return std::clamp(requested, capabilities.minImageCount, maxImageCount);
+}
+
 VkExtent2D chooseSwapExtent(GLFWwindow *window,
                             const VkSurfaceCapabilitiesKHR &capabilities) {
   if (capabilities.currentExtent.width !=
@@ -156,14 +197,25 @@ QueueFamilyIndices findQueueFamilies(VkPhysicalDevice physicalDevice,
   vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount,
                                            queueFamilies.data());
 
-  for (uint32_t i = 0; i < queueFamilyCount, !indices.isComplete(); i++) {
+  for (uint32_t i = 0; i < queueFamilyCount && !indices.isComplete(); i++) {
     if (queueFamilies[i].queueFlags & queueFlags)
       indices.graphicsFamily = i;
-    vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface,
-                                         &supportsPresentation);
+    if (surface == VK_NULL_HANDLE)
+      supportsPresentation = indices.graphicsFamily == i;
+    else
+      vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface,
+                                           &supportsPresentation);
     if (supportsPresentation)
       indices.presentationFamily = i;
   }
 
+  for (uint32_t i = 0; i < queueFamilyCount; i++) {
+    VkQueueFlags flags = queueFamilies[i].queueFlags;
+    if (!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT))
+      continue;
+    if (!indices.transferFamily.has_value() || !(flags & VK_QUEUE_COMPUTE_BIT))
+      indices.transferFamily = i;
+  }
+
   return indices;
 }
\ No newline at end of file
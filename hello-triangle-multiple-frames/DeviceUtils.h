@@ -1,5 +1,6 @@
 #pragma once
 #define GLFW_INCLUDE_VULKAN
+#include "PresentProfile.h"
 #include <GLFW/glfw3.h>
 #include <iostream>
 #include <optional>
@@ -8,8 +9,13 @@
 const std::vector<const char *> deviceExtensions = {
     VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 
-std::vector<const char *> getRequiredExtensions();
+// Instance extensions required by the application.
+// A headless application does not create a window surface, so it only needs
+// the extensions requested for debugging.
+std::vector<const char *> getRequiredExtensions(bool headless = false);
 bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+// Check for an optional device extension, which is only enabled when present.
+bool isDeviceExtensionSupported(VkPhysicalDevice device, const char *extension);
 
 // DEVICE INITIALIZATION
 
@@ -43,6 +49,8 @@ struct SwapChainSupportDetails {
 // The higher the score, the more suitable the device is.
 // The score is not a definitive measure of suitability, but it can help
 // to select a device that is likely to be suitable for the application.
+// When surface is VK_NULL_HANDLE (headless mode) the swap chain support of the
+// device is not taken into account.
 uint32_t rateDeviceSuitability(VkPhysicalDevice device, VkSurfaceKHR surface);
 
 SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device,
@@ -51,23 +59,43 @@ SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device,
 VkSurfaceFormatKHR chooseSwapSurfaceFormat(
     const std::vector<VkSurfaceFormatKHR> &availableFormats);
 
+// First present mode of the profile that is available. FIFO is always
+// available.
 VkPresentModeKHR chooseSwapPresentMode(
-    const std::vector<VkPresentModeKHR> &availablePresentModes);
+    const std::vector<VkPresentModeKHR> &availablePresentModes,
+    PresentProfile profile);
 
 VkExtent2D chooseSwapExtent(GLFWwindow *window,
                             const VkSurfaceCapabilitiesKHR &capabilities);
 
+// Images a swap chain may have above the minimum when the surface sets no
+// maximum
+inline const uint32_t MAX_EXTRA_SWAPCHAIN_IMAGES = 3;
+
+// Number of swap chain images closest to requested that the surface
+// supports, minImageCount + 1 when requested is 0.
+uint32_t chooseSwapImageCount(const VkSurfaceCapabilitiesKHR &capabilities,
+                              uint32_t requested);
+
 // QUEUE FAMILIES MANAGEMENT
 
 struct QueueFamilyIndices {
   std::optional<uint32_t> graphicsFamily;
   std::optional<uint32_t> presentationFamily;
+  // Family that supports transfers but not graphics, if the device has one.
+  // Its queues run on the copy engines, in parallel with rendering.
+  std::optional<uint32_t> transferFamily;
 
   bool isComplete() {
     return graphicsFamily.has_value() && presentationFamily.has_value();
   }
 };
 
+// Find the queue families supporting queueFlags and presentation to surface.
+// When surface is VK_NULL_HANDLE (headless mode) nothing is ever presented,
+// so the family found for queueFlags is also used as presentation family.
+// The transfer family is optional and a family without compute support is
+// preferred, as it is the dedicated copy engine.
 QueueFamilyIndices findQueueFamilies(VkPhysicalDevice physicalDevice,
                                      VkSurfaceKHR surface,
                                      VkQueueFlags queueFlags);
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "FileUtils.h"
+#include <cstdio>
 #include <fstream>
 std::vector<char> readFile(const std::string &filename) {
   std::ifstream file(filename, std::ios::ate | std::ios::binary);
@@ -15,6 +16,29 @@ std::vector<char> readFile(const std::string &filename) {
   return buffer;
 }
 
+void writeFileAtomic(const std::string &filename, const std::vector<char> &data) {
+  std::string temporary = filename + ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+
+    if (!file.is_open()) {
+      throw std::runtime_error("failed to open file!");
+    }
+
+    file.write(data.data(), data.size());
+    file.flush();
+    if (!file) {
+      std::remove(temporary.c_str());
+      throw std::runtime_error("failed to write file!");
+    }
+  }
+
+  if (std::rename(temporary.c_str(), filename.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    throw std::runtime_error("failed to replace file!");
+  }
+}
+
 VkShaderModule createShaderModule(VkDevice device,
                                   const std::vector<char> &code) {
   VkShaderModuleCreateInfo createInfo{
@@ -30,4 +54,17 @@ VkShaderModule createShaderModule(VkDevice device,
     throw std::runtime_error("failed to create shader module!");
 
   return shaderModule;
+}
+
+void writePPM(const std::string &filename, uint32_t width, uint32_t height,
+              const uint8_t *rgba) {
+  std::ofstream file(filename, std::ios::binary);
+
+  if (!file.is_open()) {
+    throw std::runtime_error("failed to open file!");
+  }
+
+  file << "P6\n" << width << " " << height << "\n255\n";
+  for (size_t i = 0; i < static_cast<size_t>(width) * height; i++)
+    file.write(reinterpret_cast<const char *>(rgba + i * 4), 3);
 }
\ No newline at end of file
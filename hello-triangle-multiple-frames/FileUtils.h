@@ -6,5 +6,16 @@
 
 std::vector<char> readFile(const std::string &filename);
 
+// Replace the contents of filename with data.
+// The data is written to a temporary file next to filename, which is then
+// renamed over it, so readers see either the old or the new contents, never
+// a partially written file.
+void writeFileAtomic(const std::string &filename, const std::vector<char> &data);
+
 VkShaderModule createShaderModule(VkDevice device,
-                                  const std::vector<char> &code);
\ No newline at end of file
+                                  const std::vector<char> &code);
+
+// Write an image made of tightly packed RGBA8 pixels to filename as a binary
+// PPM (P6) file. The alpha channel is dropped.
+void writePPM(const std::string &filename, uint32_t width, uint32_t height,
+              const uint8_t *rgba);
\ No newline at end of file
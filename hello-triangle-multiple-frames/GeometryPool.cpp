@@ -0,0 +1,140 @@
+#include "GeometryPool.h"
+#include "Memory.h"
+#include <cstring>
+#include <iterator>
+
+void RangeAllocator::init(uint32_t capacity)
+{
+  freeRanges.clear();
+  if (capacity > 0)
+    freeRanges[0] = capacity;
+  capacityCount = capacity;
+  freeCount = capacity;
+}
+
+std::optional<uint32_t> RangeAllocator::allocate(uint32_t count)
+{
+  for (auto range = freeRanges.begin(); range != freeRanges.end(); range++)
+  {
+    if (range->second < count)
+      continue;
+
+    uint32_t first = range->first;
+    uint32_t remaining = range->second - count;
+    freeRanges.erase(range);
+    if (remaining > 0)
+      freeRanges[first + count] = remaining;
+    freeCount -= count;
+    return first;
+  }
+
+  return std::nullopt;
+}
+
+void RangeAllocator::free(uint32_t first, uint32_t count)
+{
+  if (count == 0)
+    return;
+
+  freeCount += count;
+  auto next = freeRanges.lower_bound(first);
+  if (next != freeRanges.end() && first + count == next->first)
+  {
+    count += next->second;
+    next = freeRanges.erase(next);
+  }
+
+  if (next != freeRanges.begin())
+  {
+    auto previous = std::prev(next);
+    if (previous->first + previous->second == first)
+    {
+      previous->second += count;
+      return;
+    }
+  }
+
+  freeRanges[first] = count;
+}
+
+void GeometryPool::init(VkDevice device, MemoryAllocator &allocator,
+                        VkDeviceSize vertexStride, uint32_t vertexCapacity,
+                        uint32_t indexCapacity)
+{
+  this->device = device;
+  this->allocator = &allocator;
+  stride = vertexStride;
+  vertices.init(vertexCapacity);
+  indices.init(indexCapacity);
+
+  createBuffer(device, allocator, vertexStride * vertexCapacity,
+               VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                   VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+               MemoryUsage::GpuOnly, vertexBuffer, vertexBufferAllocation);
+  createBuffer(device, allocator, sizeof(uint16_t) * indexCapacity,
+               VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                   VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+               MemoryUsage::GpuOnly, indexBuffer, indexBufferAllocation);
+}
+
+void GeometryPool::destroy()
+{
+  destroyBuffer(device, *allocator, vertexBuffer, vertexBufferAllocation);
+  destroyBuffer(device, *allocator, indexBuffer, indexBufferAllocation);
+}
+
+Mesh GeometryPool::add(StagingRing &stagingRing, TransferBatch &uploads,
+                       const void *vertexData, uint32_t vertexCount,
+                       const uint16_t *indexData, uint32_t indexCount)
+{
+  std::optional<uint32_t> baseVertex = vertices.allocate(vertexCount);
+  if (!baseVertex)
+    throw std::runtime_error("geometry pool is out of vertices!");
+
+  std::optional<uint32_t> firstIndex = indices.allocate(indexCount);
+  if (!firstIndex)
+  {
+    vertices.free(*baseVertex, vertexCount);
+    throw std::runtime_error("geometry pool is out of indices!");
+  }
+
+  Mesh mesh{
+      .baseVertex = static_cast<int32_t>(*baseVertex),
+      .vertexCount = vertexCount,
+      .firstIndex = *firstIndex,
+      .indexCount = indexCount,
+  };
+
+  VkDeviceSize vertexSize = stride * vertexCount;
+  VkDeviceSize indexSize = sizeof(uint16_t) * indexCount;
+  StagingRegion vertexStaging = stagingRing.allocate(vertexSize);
+  StagingRegion indexStaging = stagingRing.allocate(indexSize);
+  memcpy(vertexStaging.mapped, vertexData, vertexSize);
+  memcpy(indexStaging.mapped, indexData, indexSize);
+  // The writes may sit in the CPU caches, flushing makes them visible to the
+  // copies unless the ring is in host coherent memory
+  stagingRing.flush();
+
+  uploads.copyBuffer(vertexStaging.buffer, vertexStaging.offset, vertexBuffer,
+                     stride * *baseVertex, vertexSize,
+                     VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                     VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+  uploads.copyBuffer(indexStaging.buffer, indexStaging.offset, indexBuffer,
+                     sizeof(uint16_t) * *firstIndex, indexSize,
+                     VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                     VK_ACCESS_INDEX_READ_BIT);
+  return mesh;
+}
+
+void GeometryPool::remove(const Mesh &mesh)
+{
+  vertices.free(static_cast<uint32_t>(mesh.baseVertex), mesh.vertexCount);
+  indices.free(mesh.firstIndex, mesh.indexCount);
+}
+
+void GeometryPool::bind(VkCommandBuffer commandBuffer) const
+{
+  VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &offset);
+  vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+}
@@ -0,0 +1,102 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include "MemoryAllocator.h"
+#include "StagingRing.h"
+#include "TransferQueue.h"
+#include <GLFW/glfw3.h>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+// Number of vertices and of indices the geometry pool created at startup
+// has room for.
+inline const uint32_t GEOMETRY_POOL_VERTICES = 256 * 1024;
+inline const uint32_t GEOMETRY_POOL_INDICES = 1024 * 1024;
+
+// First-fit allocator of ranges of elements in [0, capacity).
+// A freed range is merged with the free ranges next to it, so that space
+// given back in pieces can be reused for larger ranges.
+class RangeAllocator
+{
+public:
+  void init(uint32_t capacity);
+
+  // First element of count consecutive free elements, none when no free
+  // range is large enough
+  std::optional<uint32_t> allocate(uint32_t count);
+  void free(uint32_t first, uint32_t count);
+
+  uint32_t capacity() const { return capacityCount; }
+  uint32_t used() const { return capacityCount - freeCount; }
+
+private:
+  // First element of every free range, and its number of elements
+  std::map<uint32_t, uint32_t> freeRanges;
+  uint32_t capacityCount = 0;
+  uint32_t freeCount = 0;
+};
+
+// Place of a mesh in the GeometryPool, drawn with
+// vkCmdDrawIndexed(indexCount, instances, firstIndex, baseVertex, ...)
+struct Mesh
+{
+  int32_t baseVertex = 0;
+  uint32_t vertexCount = 0;
+  uint32_t firstIndex = 0;
+  uint32_t indexCount = 0;
+};
+
+// One vertex buffer and one index buffer shared by every mesh.
+// Meshes are ranges of the two buffers handed out by a RangeAllocator, so
+// adding one costs no buffer and no device memory allocation, and any
+// number of them are drawn after a single bind().
+// Indices are 16-bit and relative to the first vertex of their mesh.
+class GeometryPool
+{
+public:
+  void init(VkDevice device, MemoryAllocator &allocator,
+            VkDeviceSize vertexStride, uint32_t vertexCapacity,
+            uint32_t indexCapacity);
+  void destroy();
+
+  // Allocate a mesh and record the upload of its vertices and indices into
+  // uploads, staged in stagingRing. The mesh can be drawn once uploads has
+  // been submitted. Throws when the pool is full.
+  Mesh add(StagingRing &stagingRing, TransferBatch &uploads,
+           const void *vertices, uint32_t vertexCount, const uint16_t *indices,
+           uint32_t indexCount);
+
+  template <typename Vertex>
+  Mesh add(StagingRing &stagingRing, TransferBatch &uploads,
+           const std::vector<Vertex> &vertices,
+           const std::vector<uint16_t> &indices)
+  {
+    if (sizeof(Vertex) != stride)
+      throw std::runtime_error("vertex does not match the geometry pool!");
+
+    return add(stagingRing, uploads, vertices.data(),
+               static_cast<uint32_t>(vertices.size()), indices.data(),
+               static_cast<uint32_t>(indices.size()));
+  }
+
+  // Give the ranges of mesh back to the pool. The GPU must be done with it.
+  void remove(const Mesh &mesh);
+
+  // Bind the vertex buffer to binding 0, and the index buffer
+  void bind(VkCommandBuffer commandBuffer) const;
+
+  const RangeAllocator &vertexRanges() const { return vertices; }
+  const RangeAllocator &indexRanges() const { return indices; }
+
+private:
+  VkDevice device = VK_NULL_HANDLE;
+  MemoryAllocator *allocator = nullptr;
+  VkDeviceSize stride = 0;
+  VkBuffer vertexBuffer = VK_NULL_HANDLE;
+  Allocation vertexBufferAllocation;
+  VkBuffer indexBuffer = VK_NULL_HANDLE;
+  Allocation indexBufferAllocation;
+  RangeAllocator vertices;
+  RangeAllocator indices;
+};
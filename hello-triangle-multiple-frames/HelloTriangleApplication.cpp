@@ -3,16 +3,95 @@
 #include "FileUtils.h"
 #include "Memory.h"
 #include "Shading.h"
+#include "VertexPacking.h"
+#include <cmath>
 #include <set>
+#include <thread>
+
+static const VkImageSubresourceRange COLOR_SUBRESOURCE_RANGE{
+    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+    .baseMipLevel = 0,
+    .levelCount = 1,
+    .baseArrayLayer = 0,
+    .layerCount = 1,
+};
+
+// Instances written by one worker task of updateInstances()
+static const uint32_t INSTANCES_PER_TASK = 64 * 1024;
+// Rotation of the instances per frame, in radians
+static const double INSTANCE_ROTATION_STEP = 0.02;
+static const double TWO_PI = 6.283185307179586;
+// Share of the staging ring the indirect draws and their bounds may take
+// when they are uploaded at startup, the rest is left to the geometry
+static const VkDeviceSize INDIRECT_UPLOAD_BUDGET = STAGING_RING_SIZE / 2;
+// Threads per workgroup of shaders/cull.comp
+static const uint32_t CULL_WORKGROUP_SIZE = 64;
+
+// Push constants of shaders/cull.comp
+struct CullConstants
+{
+  // The view, as the planes a visible point p is inside of:
+  // dot(plane.xy, p) + plane.w >= 0
+  glm::vec4 planes[4];
+  uint32_t objectCount;
+  // Compact the visible draws and count them for
+  // vkCmdDrawIndexedIndirectCount, or keep every draw in place and zero the
+  // instances of the culled ones
+  uint32_t compact;
+};
+
+// The instances are laid out row by row on a square grid covering
+// [-extent, extent] in clip space, each rotating in place in its cell
+struct InstanceGrid
+{
+  uint32_t side;
+  float cell;
+  float extent;
+
+  float center(uint32_t column) const
+  {
+    return -extent + (column + 0.5f) * cell;
+  }
+  float scale() const { return 0.8f * cell; }
+};
+
+static InstanceGrid instanceGrid(uint32_t instanceCount, float extent)
+{
+  uint32_t side =
+      static_cast<uint32_t>(std::ceil(std::sqrt(double(instanceCount))));
+  return {side, 2.0f * extent / side, extent};
+}
+
+static void writeInstances(InstanceData *instances, uint32_t first,
+                           uint32_t count, const InstanceGrid &grid,
+                           uint64_t frameNumber)
+{
+  // Wrapped to one turn in double precision, so that the angle neither
+  // jumps nor loses precision as the frame number grows
+  float rotation = static_cast<float>(
+      std::fmod(frameNumber * INSTANCE_ROTATION_STEP, TWO_PI));
+  for (uint32_t i = first; i < first + count; i++)
+  {
+    uint32_t column = i % grid.side;
+    uint32_t row = i / grid.side;
+    float u = static_cast<float>(column) / grid.side;
+    float v = static_cast<float>(row) / grid.side;
+    instances[i].transform = {grid.center(column), grid.center(row),
+                              grid.scale(), rotation + column * 0.1f};
+    instances[i].color = {u, v, 1.0f - u};
+  }
+}
 
 void HelloTriangleApplication::initWindow()
 {
   glfwInit();
   glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-  glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+  glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
   window = glfwCreateWindow(WIDTH, HEIGHT, APP_NAME, nullptr, nullptr);
 
+  glfwSetWindowUserPointer(window, this);
   glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+  glfwSetKeyCallback(window, keyCallback);
 }
 
 void HelloTriangleApplication::createInstance()
@@ -27,10 +106,10 @@ void HelloTriangleApplication::createInstance()
       .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
       .pEngineName = "No Engine",
       .engineVersion = VK_MAKE_VERSION(1, 0, 0),
-      .apiVersion = VK_API_VERSION_1_0,
+      .apiVersion = VK_API_VERSION_1_3,
   };
 
-  auto requiredExtensions = getRequiredExtensions();
+  auto requiredExtensions = getRequiredExtensions(config.headless);
   uint32_t availableExtensionCount = 0;
   vkEnumerateInstanceExtensionProperties(nullptr, &availableExtensionCount,
                                          nullptr);
@@ -139,6 +218,8 @@ void HelloTriangleApplication::createLogicalDevice()
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
   std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(),
                                             indices.presentationFamily.value()};
+  if (indices.transferFamily.has_value())
+    uniqueQueueFamilies.insert(indices.transferFamily.value());
   float queuePriority = 1.0f;
   for (uint32_t queueFamily : uniqueQueueFamilies)
     queueCreateInfos.push_back({
@@ -148,19 +229,101 @@ void HelloTriangleApplication::createLogicalDevice()
         .pQueuePriorities = &queuePriority,
     });
 
+  // Indirect draws need several draws per call, each with its own first
+  // instance. Every draw is issued by a single call and uploaded at startup
+  // with its bounds, so the draw count must fit both the device limit and
+  // the staging ring. Otherwise the draws are issued directly.
+  VkPhysicalDeviceFeatures supportedFeatures;
+  vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  VkDeviceSize indirectUploadSize =
+      VkDeviceSize(config.drawCount) *
+      (sizeof(VkDrawIndexedIndirectCommand) +
+       (config.gpuCulling ? sizeof(glm::vec4) : 0));
+  indirectDrawsSupported =
+      config.indirectDraws && supportedFeatures.multiDrawIndirect &&
+      supportedFeatures.drawIndirectFirstInstance &&
+      config.drawCount <= properties.limits.maxDrawIndirectCount &&
+      indirectUploadSize <= INDIRECT_UPLOAD_BUDGET;
+  if (config.indirectDraws && !indirectDrawsSupported)
+    std::cout << "Indirect draws not supported for " << config.drawCount
+              << " draws, the draws are issued directly" << std::endl;
+
   VkPhysicalDeviceFeatures deviceFeatures{};
+  deviceFeatures.multiDrawIndirect = indirectDrawsSupported;
+  deviceFeatures.drawIndirectFirstInstance = indirectDrawsSupported;
+  gpuCullingSupported = config.gpuCulling && indirectDrawsSupported;
+
+  // Headless rendering never presents, so it does not need VK_KHR_swapchain.
+  std::vector<const char *> extensions;
+  if (!config.headless)
+    extensions = deviceExtensions;
+
+  // Heap budgets let the allocator avoid heaps that are running out of
+  // memory. Querying them needs vkGetPhysicalDeviceMemoryProperties2.
+  memoryBudgetSupported =
+      properties.apiVersion >= VK_API_VERSION_1_1 &&
+      isDeviceExtensionSupported(physicalDevice,
+                                 VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  if (memoryBudgetSupported)
+    extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+  // Timeline semaphores and indirect draw counts are core in Vulkan 1.2 and
+  // dynamic rendering in Vulkan 1.3, but all are still optional features
+  VkPhysicalDeviceVulkan13Features supported13{};
+  supported13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+  VkPhysicalDeviceVulkan12Features supported12{};
+  supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  if (properties.apiVersion >= VK_API_VERSION_1_3)
+    supported12.pNext = &supported13;
+  VkPhysicalDeviceFeatures2 supported{
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+      .pNext = &supported12,
+  };
+  if (properties.apiVersion >= VK_API_VERSION_1_2)
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &supported);
+  timelineSemaphoresSupported = config.timelineSemaphores &&
+                                properties.apiVersion >= VK_API_VERSION_1_2 &&
+                                supported12.timelineSemaphore;
+  drawIndirectCountSupported = indirectDrawsSupported &&
+                               properties.apiVersion >= VK_API_VERSION_1_2 &&
+                               supported12.drawIndirectCount;
+  dynamicRenderingSupported = config.dynamicRendering &&
+                              properties.apiVersion >= VK_API_VERSION_1_3 &&
+                              supported13.dynamicRendering;
+
+  void *enabledFeatures = nullptr;
+  VkPhysicalDeviceVulkan13Features enabled13{};
+  enabled13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+  enabled13.dynamicRendering = VK_TRUE;
+  if (dynamicRenderingSupported)
+  {
+    enabled13.pNext = enabledFeatures;
+    enabledFeatures = &enabled13;
+  }
+
+  VkPhysicalDeviceVulkan12Features enabled12{};
+  enabled12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  enabled12.timelineSemaphore = timelineSemaphoresSupported;
+  enabled12.drawIndirectCount = drawIndirectCountSupported;
+  if (timelineSemaphoresSupported || drawIndirectCountSupported)
+  {
+    enabled12.pNext = enabledFeatures;
+    enabledFeatures = &enabled12;
+  }
 
   VkDeviceCreateInfo createInfo{
       .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-      .pNext = nullptr,
+      .pNext = enabledFeatures,
       .queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size()),
       .pQueueCreateInfos = queueCreateInfos.data(),
       .enabledLayerCount = static_cast<uint32_t>(
           enableValidationLayers ? validationLayers.size() : 0),
       .ppEnabledLayerNames =
           enableValidationLayers ? validationLayers.data() : nullptr,
-      .enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size()),
-      .ppEnabledExtensionNames = deviceExtensions.data(),
+      .enabledExtensionCount = static_cast<uint32_t>(extensions.size()),
+      .ppEnabledExtensionNames = extensions.data(),
       .pEnabledFeatures = &deviceFeatures,
   };
 
@@ -171,6 +334,21 @@ void HelloTriangleApplication::createLogicalDevice()
   vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &qGraphics);
   vkGetDeviceQueue(device, indices.presentationFamily.value(), 0,
                    &qPresentation);
+  if (indices.transferFamily.has_value())
+    vkGetDeviceQueue(device, indices.transferFamily.value(), 0, &qTransfer);
+}
+
+void HelloTriangleApplication::createTransferQueue()
+{
+  auto indices =
+      findQueueFamilies(physicalDevice, surface, VK_QUEUE_GRAPHICS_BIT);
+
+  if (qTransfer != VK_NULL_HANDLE)
+    transferSubmissions.init(device, qTransfer, timelineSemaphoresSupported);
+
+  transfers.init(device, graphicsSubmissions, indices.graphicsFamily.value(),
+                 qTransfer != VK_NULL_HANDLE ? &transferSubmissions : nullptr,
+                 indices.transferFamily.value_or(0));
 }
 
 void HelloTriangleApplication::createSwapChain()
@@ -181,16 +359,20 @@ void HelloTriangleApplication::createSwapChain()
   VkSurfaceFormatKHR surfaceFormat =
       chooseSwapSurfaceFormat(swapChainSupport.formats);
   VkPresentModeKHR presentMode =
-      chooseSwapPresentMode(swapChainSupport.presentModes);
+      chooseSwapPresentMode(swapChainSupport.presentModes, presentProfile);
   VkExtent2D extent = chooseSwapExtent(window, swapChainSupport.capabilities);
 
-  uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+  // The adaptive count moves between the limits of the surface
+  if (swapChain == VK_NULL_HANDLE && config.adaptiveSwapchainImages)
+    adaptiveImages.init(
+        swapChainSupport.capabilities.minImageCount,
+        chooseSwapImageCount(swapChainSupport.capabilities, UINT32_MAX));
 
-  if (swapChainSupport.capabilities.maxImageCount > 0 &&
-      imageCount > swapChainSupport.capabilities.maxImageCount)
-  {
-    imageCount = swapChainSupport.capabilities.maxImageCount;
-  }
+  uint32_t imageCount =
+      chooseSwapImageCount(swapChainSupport.capabilities, swapChainImageCount);
+  // The implementation may create more images than asked for, the count
+  // asked for is the one the adaptive count changes
+  swapChainImageCount = imageCount;
 
   VkSwapchainCreateInfoKHR createInfo{
       .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
@@ -211,6 +393,7 @@ void HelloTriangleApplication::createSwapChain()
       .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
       .presentMode = presentMode,
       .clipped = VK_TRUE,
+      .oldSwapchain = swapChain,
   };
 
   QueueFamilyIndices indices =
@@ -242,6 +425,191 @@ void HelloTriangleApplication::createSwapChain()
                           swapChainImages.data());
   swapChainImageFormat = surfaceFormat.format;
   swapChainExtent = extent;
+  swapChainPresentMode = presentMode;
+}
+
+void HelloTriangleApplication::createOffscreenTargets()
+{
+  swapChainImageFormat = OFFSCREEN_FORMAT;
+  swapChainExtent = {WIDTH, HEIGHT};
+  swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+  offscreenImageAllocations.resize(MAX_FRAMES_IN_FLIGHT);
+
+  for (size_t i = 0; i < swapChainImages.size(); i++)
+  {
+    VkImageCreateInfo imageInfo{
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .pNext = nullptr,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = swapChainImageFormat,
+        .extent = {swapChainExtent.width, swapChainExtent.height, 1},
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                 VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+
+    if (vkCreateImage(device, &imageInfo, nullptr, &swapChainImages[i]) !=
+        VK_SUCCESS)
+      throw std::runtime_error("failed to create offscreen image!");
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, swapChainImages[i], &memRequirements);
+
+    offscreenImageAllocations[i] = allocator.allocate(
+        memRequirements, MemoryUsage::GpuOnly, ResourceKind::Optimal);
+
+    vkBindImageMemory(device, swapChainImages[i],
+                      offscreenImageAllocations[i].memory,
+                      offscreenImageAllocations[i].offset);
+  }
+}
+
+void HelloTriangleApplication::saveScreenshot(const std::string &filename)
+{
+  VkDeviceSize bufferSize =
+      static_cast<VkDeviceSize>(swapChainExtent.width) *
+      swapChainExtent.height * 4;
+  VkBuffer readbackBuffer;
+  Allocation readbackBufferAllocation;
+
+  createBuffer(device, allocator, bufferSize,
+               VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::Readback,
+               readbackBuffer, readbackBufferAllocation);
+
+  copyImageToBuffer(device, commandPool, graphicsSubmissions,
+                    swapChainImages[lastImageIndex], swapChainExtent,
+                    readbackBuffer);
+  allocator.invalidate(readbackBufferAllocation);
+
+  writePPM(filename, swapChainExtent.width, swapChainExtent.height,
+           static_cast<const uint8_t *>(readbackBufferAllocation.mapped));
+
+  destroyBuffer(device, allocator, readbackBuffer, readbackBufferAllocation);
+}
+
+void HelloTriangleApplication::writeBenchmarkResults()
+{
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+  benchmark.setInfo("device", properties.deviceName);
+  benchmark.setInfo("mode", config.headless ? "headless" : "windowed");
+  if (config.benchmarkDepthSweep)
+    benchmark.setInfo("frames_in_flight", "sweep");
+  else if (config.adaptiveFramesInFlight)
+    benchmark.setInfo("frames_in_flight", "adaptive");
+  else
+    benchmark.setInfo("frames_in_flight", config.framesInFlight);
+  benchmark.setInfo("frames_in_flight_final", framesInFlight);
+  benchmark.setInfo("present_profile",
+                    config.benchmarkProfileSweep
+                        ? "sweep"
+                        : presentProfileName(config.presentProfile));
+  benchmark.setInfo("present_mode", config.headless
+                                        ? "none"
+                                        : presentModeName(swapChainPresentMode));
+  benchmark.setInfo("frame_cap", presentProfileFrameCap(presentProfile,
+                                                        config.frameCap));
+  benchmark.setInfo("swapchain_images",
+                    config.adaptiveSwapchainImages ? "auto"
+                    : config.swapchainImages == 0
+                        ? "default"
+                        : std::to_string(config.swapchainImages));
+  benchmark.setInfo("swapchain_images_final",
+                    config.headless ? 0 : swapChainImageCount);
+  benchmark.setInfo("swapchain_image_changes", adaptiveImages.changeCount());
+  benchmark.setInfo("acquire_wait_ms", benchmark.mean("acquire_ms"));
+  benchmark.setInfo("frames_in_flight_changes", adaptiveDepth.changeCount());
+  benchmark.setInfo("width", swapChainExtent.width);
+  benchmark.setInfo("height", swapChainExtent.height);
+
+  MemoryStats memoryStats = allocator.stats();
+  benchmark.setInfo("memory_blocks", memoryStats.blockCount);
+  benchmark.setInfo("memory_dedicated_allocations", memoryStats.dedicatedCount);
+  benchmark.setInfo("memory_allocations", memoryStats.allocationCount);
+  benchmark.setInfo("memory_driver_allocations",
+                    memoryStats.driverAllocationCount);
+  benchmark.setInfo("memory_reserved_bytes", memoryStats.reservedBytes);
+  benchmark.setInfo("memory_allocated_bytes", memoryStats.allocatedBytes);
+  // Compare the startup time of a run without a pipeline cache file (cold)
+  // with the one of a run that found the file of the previous run (warm)
+  benchmark.setInfo("pipeline_cache",
+                    config.pipelineCachePath.empty() ? "disabled"
+                    : pipelineCacheLoaded           ? "warm"
+                                                    : "cold");
+  benchmark.setInfo("startup_ms", startupMilliseconds);
+  benchmark.setInfo("pipeline_creation_ms", pipelineMilliseconds);
+  benchmark.setInfo("pipeline_workers", workers.size());
+  benchmark.setInfo("draws", config.drawCount);
+  benchmark.setInfo("instances", config.instanceCount);
+  benchmark.setInfo("draw_submission", !indirectDrawsSupported ? "direct"
+                                       : drawIndirectCountSupported
+                                           ? "indirect count"
+                                           : "indirect");
+  benchmark.setInfo("gpu_culling", gpuCullingSupported ? "on" : "off");
+  benchmark.setInfo("scene_extent", config.sceneExtent);
+  benchmark.setInfo("geometry_vertices", geometry.vertexRanges().used());
+  benchmark.setInfo("vertex_format", vertexFormatName(config.vertexFormat));
+  benchmark.setInfo("vertex_bytes", vertexStride(config.vertexFormat));
+  benchmark.setInfo("geometry_indices", geometry.indexRanges().used());
+  benchmark.setInfo("record_threads", config.recordThreads);
+  benchmark.setInfo("command_buffer_reuse",
+                    config.reuseCommandBuffers ? "enabled" : "disabled");
+  benchmark.setInfo("command_buffers_recorded", commandBuffers.recordCount());
+  benchmark.setInfo("command_buffers_reused", commandBuffers.reuseCount());
+  benchmark.setInfo("transfer_queue",
+                    transfers.dedicated() ? "dedicated" : "graphics");
+  benchmark.setInfo("frame_sync", timelineSemaphoresSupported
+                                      ? "timeline semaphores"
+                                      : "fences");
+  benchmark.setInfo("rendering", dynamicRenderingSupported
+                                     ? "dynamic rendering"
+                                     : "render pass");
+  benchmark.setInfo("memory_budget", memoryBudgetSupported
+                                         ? "VK_EXT_memory_budget"
+                                         : "heap size");
+
+  // The GPU time is compared to the CPU time spent on the frame without
+  // waiting, i.e. without the fence wait and the image acquisition
+  if (benchmark.count("gpu_render_pass_ms") > 0)
+  {
+    double cpuBusy = benchmark.mean("frame_cpu_ms") -
+                     benchmark.mean("fence_wait_ms") -
+                     benchmark.mean("acquire_ms");
+    benchmark.setInfo("bound", benchmark.mean("gpu_render_pass_ms") > cpuBusy
+                                   ? "gpu"
+                                   : "cpu");
+  }
+
+  // Throughput of every depth that was measured, its latency is in the
+  // latency_ms_depth<n> metric
+  for (uint32_t depth = MIN_FRAMES_IN_FLIGHT; depth <= MAX_FRAMES_IN_FLIGHT;
+       depth++)
+  {
+    double frameMilliseconds =
+        benchmark.mean("frame_ms_depth" + std::to_string(depth));
+    if (frameMilliseconds > 0.0)
+      benchmark.setInfo("fps_depth" + std::to_string(depth),
+                        1000.0 / frameMilliseconds);
+  }
+  // Same for every present profile, see latency_ms_<profile>
+  for (PresentProfile profile : PRESENT_PROFILES)
+  {
+    std::string name = presentProfileName(profile);
+    double frameMilliseconds = benchmark.mean("frame_ms_" + name);
+    if (frameMilliseconds > 0.0)
+      benchmark.setInfo("fps_" + name, 1000.0 / frameMilliseconds);
+  }
+  benchmark.writeJson(config.benchmarkOutputPath);
+
+  std::cout << "Benchmark results (" << benchmark.measuredFrames()
+            << " frames) written to " << config.benchmarkOutputPath
+            << std::endl;
 }
 
 void HelloTriangleApplication::createImageViews()
@@ -288,7 +656,10 @@ void HelloTriangleApplication::createRenderPass()
       .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
       .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
       .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-      .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+      // Offscreen images are never presented, but they can be copied to the
+      // host when a screenshot is requested
+      .finalLayout = config.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                     : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
   };
 
   VkAttachmentReference colorAttachmentRef{
@@ -327,9 +698,26 @@ void HelloTriangleApplication::createRenderPass()
     throw std::runtime_error("failed to create render pass!");
 }
 
-void HelloTriangleApplication::createGraphicsPipeline(bool useDynamicState)
+// Vertex input of the pipelines reading the vertices from Stream, followed by
+// the instance data in the instanced mode
+template <typename Stream>
+static void
+appendVertexInput(bool instanced,
+                  std::vector<VkVertexInputBindingDescription> &bindings,
+                  std::vector<VkVertexInputAttributeDescription> &attributes)
+{
+  if (instanced)
+    VertexLayout<Stream, InstanceStream>::append(bindings, attributes);
+  else
+    VertexLayout<Stream>::append(bindings, attributes);
+}
+
+void HelloTriangleApplication::createGraphicsPipelines()
 {
-  auto vertShaderCode = readFile("shaders/vert.spv");
+  // The instanced vertex shader also reads the instance attributes
+  auto vertShaderCode = readFile(config.instanceCount > 0
+                                     ? "shaders/instanced_vert.spv"
+                                     : "shaders/vert.spv");
   auto fragShaderCode = readFile("shaders/frag.spv");
   std::vector<VkDynamicState> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT,
                                                VK_DYNAMIC_STATE_SCISSOR};
@@ -362,13 +750,32 @@ void HelloTriangleApplication::createGraphicsPipeline(bool useDynamicState)
       .pDynamicStates = dynamicStates.data(),
   };
 
-  auto bindingDescription = Vertex::getBindingDescription();
-  auto attributeDescriptions = Vertex::getAttributeDescriptions();
+  std::vector<VkVertexInputBindingDescription> bindingDescriptions;
+  std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+  switch (config.vertexFormat)
+  {
+  case VertexFormat::Float:
+    appendVertexInput<FloatVertexStream>(config.instanceCount > 0,
+                                         bindingDescriptions,
+                                         attributeDescriptions);
+    break;
+  case VertexFormat::Snorm16:
+    appendVertexInput<Snorm16VertexStream>(config.instanceCount > 0,
+                                           bindingDescriptions,
+                                           attributeDescriptions);
+    break;
+  case VertexFormat::Half:
+    appendVertexInput<HalfVertexStream>(config.instanceCount > 0,
+                                        bindingDescriptions,
+                                        attributeDescriptions);
+    break;
+  }
 
   VkPipelineVertexInputStateCreateInfo vertexInputInfo{
       .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-      .vertexBindingDescriptionCount = 1,
-      .pVertexBindingDescriptions = &bindingDescription,
+      .vertexBindingDescriptionCount =
+          static_cast<uint32_t>(bindingDescriptions.size()),
+      .pVertexBindingDescriptions = bindingDescriptions.data(),
       .vertexAttributeDescriptionCount =
           static_cast<uint32_t>(attributeDescriptions.size()),
       .pVertexAttributeDescriptions = attributeDescriptions.data(),
@@ -397,9 +804,17 @@ void HelloTriangleApplication::createGraphicsPipeline(bool useDynamicState)
   VkPipelineViewportStateCreateInfo viewportState{
       .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
       .viewportCount = 1,
-      .pViewports = useDynamicState ? nullptr : &viewport,
+      .pViewports = &viewport,
       .scissorCount = 1,
-      .pScissors = useDynamicState ? nullptr : &scissor,
+      .pScissors = &scissor,
+  };
+
+  VkPipelineViewportStateCreateInfo dynamicViewportState{
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+      .viewportCount = 1,
+      .pViewports = nullptr,
+      .scissorCount = 1,
+      .pScissors = nullptr,
   };
 
   VkPipelineRasterizationStateCreateInfo rasterizer{
@@ -446,9 +861,21 @@ void HelloTriangleApplication::createGraphicsPipeline(bool useDynamicState)
                              &pipelineLayout) != VK_SUCCESS)
     throw std::runtime_error("failed to create pipeline layout!");
 
+  // With dynamic rendering there is no render pass to be compatible with,
+  // the pipeline declares the formats of the attachments instead
+  VkPipelineRenderingCreateInfo renderingInfo{
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+      .pNext = nullptr,
+      .viewMask = 0,
+      .colorAttachmentCount = 1,
+      .pColorAttachmentFormats = &swapChainImageFormat,
+      .depthAttachmentFormat = VK_FORMAT_UNDEFINED,
+      .stencilAttachmentFormat = VK_FORMAT_UNDEFINED,
+  };
+
   VkGraphicsPipelineCreateInfo pipelineInfo{
       .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-      .pNext = nullptr,
+      .pNext = dynamicRenderingSupported ? &renderingInfo : nullptr,
       .stageCount = 2,
       .pStages = shaderStages,
       .pVertexInputState = &vertexInputInfo,
@@ -458,20 +885,119 @@ void HelloTriangleApplication::createGraphicsPipeline(bool useDynamicState)
       .pMultisampleState = &multisampling,
       .pDepthStencilState = nullptr, // Optional
       .pColorBlendState = &colorBlending,
-      .pDynamicState = useDynamicState ? &dynamicState : nullptr, // Optional
+      .pDynamicState = nullptr, // Optional
       .layout = pipelineLayout,
       .renderPass = renderPass,
       .basePipelineHandle = VK_NULL_HANDLE, // Optional
       .basePipelineIndex = -1,              // Optional
   };
-  if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo,
-                                nullptr, &graphicsPipeline) != VK_SUCCESS)
-    throw std::runtime_error("failed to create graphics pipeline!");
+
+  // Same pipeline, with the viewport and the scissor set when recording
+  VkGraphicsPipelineCreateInfo dynamicPipelineInfo = pipelineInfo;
+  dynamicPipelineInfo.pViewportState = &dynamicViewportState;
+  dynamicPipelineInfo.pDynamicState = &dynamicState;
+
+  auto start = Benchmark::Clock::now();
+  auto futures = pipelineCompiler.compile({pipelineInfo, dynamicPipelineInfo});
+  // The create infos point into this stack frame, so every pipeline must be
+  // compiled before returning, even when one of them fails
+  auto pipelines = pipelineCompiler.wait(futures);
+  pipelineMilliseconds += std::chrono::duration<double, std::milli>(
+                              Benchmark::Clock::now() - start)
+                              .count();
+
+  graphicsPipeline = pipelines[0];
+  dynamicViewportPipeline = pipelines[1];
+  staticPipelineExtent = swapChainExtent;
 
   vkDestroyShaderModule(device, fragShaderModule, nullptr);
   vkDestroyShaderModule(device, vertShaderModule, nullptr);
 }
 
+void HelloTriangleApplication::createCullPipeline()
+{
+  // Bounds, all the draws, the visible draws and their number
+  std::array<VkDescriptorSetLayoutBinding, 4> bindings;
+  for (uint32_t i = 0; i < bindings.size(); i++)
+    bindings[i] = {
+        .binding = i,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 1,
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .pImmutableSamplers = nullptr,
+    };
+
+  VkDescriptorSetLayoutCreateInfo setLayoutInfo{
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .bindingCount = static_cast<uint32_t>(bindings.size()),
+      .pBindings = bindings.data(),
+  };
+
+  if (vkCreateDescriptorSetLayout(device, &setLayoutInfo, nullptr,
+                                  &cullSetLayout) != VK_SUCCESS)
+    throw std::runtime_error("failed to create descriptor set layout!");
+
+  VkPushConstantRange pushConstantRange{
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      .offset = 0,
+      .size = sizeof(CullConstants),
+  };
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .setLayoutCount = 1,
+      .pSetLayouts = &cullSetLayout,
+      .pushConstantRangeCount = 1,
+      .pPushConstantRanges = &pushConstantRange,
+  };
+
+  if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr,
+                             &cullPipelineLayout) != VK_SUCCESS)
+    throw std::runtime_error("failed to create pipeline layout!");
+
+  auto cullShaderCode = readFile("shaders/cull_comp.spv");
+  VkShaderModule cullShaderModule = createShaderModule(device, cullShaderCode);
+
+  VkComputePipelineCreateInfo pipelineInfo{
+      .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .stage =
+          {
+              .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+              .pNext = nullptr,
+              .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+              .module = cullShaderModule,
+              .pName = "main",
+          },
+      .layout = cullPipelineLayout,
+      .basePipelineHandle = VK_NULL_HANDLE,
+      .basePipelineIndex = -1,
+  };
+
+  auto start = Benchmark::Clock::now();
+  std::vector<std::future<VkPipeline>> futures;
+  futures.push_back(pipelineCompiler.compile(pipelineInfo));
+  cullPipeline = pipelineCompiler.wait(futures)[0];
+  pipelineMilliseconds += std::chrono::duration<double, std::milli>(
+                              Benchmark::Clock::now() - start)
+                              .count();
+
+  vkDestroyShaderModule(device, cullShaderModule, nullptr);
+}
+
+void HelloTriangleApplication::createPipelineCache()
+{
+  pipelineCache = loadPipelineCache(device, physicalDevice,
+                                    config.pipelineCachePath,
+                                    pipelineCacheLoaded);
+  pipelineCompiler.init(device, pipelineCache, workers);
+}
+
 void HelloTriangleApplication::createFramebuffers()
 {
   swapChainFramebuffers.resize(swapChainImageViews.size());
@@ -512,87 +1038,245 @@ void HelloTriangleApplication::createCommandPool()
     throw std::runtime_error("failed to create command pool!");
 }
 
-void HelloTriangleApplication::createVertexBuffer()
+void HelloTriangleApplication::createGeometry()
 {
-  VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingBufferMemory;
-
-  createBuffer(device, physicalDevice, bufferSize,
-               VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-               stagingBuffer, stagingBufferMemory);
+  geometry.init(device, allocator, vertexStride(config.vertexFormat),
+                GEOMETRY_POOL_VERTICES, GEOMETRY_POOL_INDICES);
+  if (config.vertexFormat == VertexFormat::Float)
+    quadMesh = geometry.add(stagingRing, uploads, vertices, indices);
+  else
+    quadMesh = geometry.add(stagingRing, uploads,
+                            packVertices(vertices, config.vertexFormat),
+                            indices);
+}
 
-  void *data;
-  // you can also use VK_WHOLE_SIZE to map all of the memory
-  if (vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data) !=
-      VK_SUCCESS)
-    throw std::runtime_error("failed to map vertex buffer memory!");
+glm::vec4 HelloTriangleApplication::drawBounds(uint32_t draw) const
+{
+  // Without instances every draw renders the quad as it is
+  if (config.instanceCount == 0)
+    return {-0.5f, -0.5f, 0.5f, 0.5f};
+
+  VkDrawIndexedIndirectCommand command = drawCommand(draw);
+  if (command.instanceCount == 0)
+    return {0.0f, 0.0f, 0.0f, 0.0f};
+
+  // The instances of a draw are consecutive cells of the grid: part of a
+  // row, or whole rows once they span several
+  InstanceGrid grid = instanceGrid(config.instanceCount, config.sceneExtent);
+  uint32_t first = command.firstInstance;
+  uint32_t last = first + command.instanceCount - 1;
+  uint32_t firstRow = first / grid.side;
+  uint32_t lastRow = last / grid.side;
+  uint32_t firstColumn = firstRow == lastRow ? first % grid.side : 0;
+  uint32_t lastColumn = firstRow == lastRow ? last % grid.side : grid.side - 1;
+  // Half the diagonal of the quad, which it never leaves while rotating
+  float radius = 0.70710678f * grid.scale();
+  return {grid.center(firstColumn) - radius, grid.center(firstRow) - radius,
+          grid.center(lastColumn) + radius, grid.center(lastRow) + radius};
+}
 
-  /*
-  Unfortunately the driver may not immediately copy the data into the buffer
-  memory, for example because of caching. It is also possible that writes to the
-  buffer are not visible in the mapped memory yet. There are two ways to deal
-  with that problem:
+void HelloTriangleApplication::createCullBuffers()
+{
+  VkDeviceSize boundsSize = sizeof(glm::vec4) * config.drawCount;
+  StagingRegion staging = stagingRing.allocate(boundsSize);
+  auto *bounds = static_cast<glm::vec4 *>(staging.mapped);
+  for (uint32_t draw = 0; draw < config.drawCount; draw++)
+    bounds[draw] = drawBounds(draw);
+  stagingRing.flush();
+
+  createBuffer(device, allocator, boundsSize,
+               VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+               MemoryUsage::GpuOnly, drawBoundsBuffer,
+               drawBoundsBufferAllocation);
+  uploads.copyBuffer(staging.buffer, staging.offset, drawBoundsBuffer, 0,
+                     boundsSize, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                     VK_ACCESS_SHADER_READ_BIT);
+
+  VkDeviceSize drawsSize =
+      sizeof(VkDrawIndexedIndirectCommand) * config.drawCount;
+  visibleDrawBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+  visibleDrawBufferAllocations.resize(MAX_FRAMES_IN_FLIGHT);
+  visibleCountBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+  visibleCountBufferAllocations.resize(MAX_FRAMES_IN_FLIGHT);
+  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+  {
+    createBuffer(device, allocator, drawsSize,
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                     VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                 MemoryUsage::GpuOnly, visibleDrawBuffers[i],
+                 visibleDrawBufferAllocations[i]);
+    createBuffer(device, allocator, sizeof(uint32_t),
+                 VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                     VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                 MemoryUsage::Readback, visibleCountBuffers[i],
+                 visibleCountBufferAllocations[i]);
+  }
 
-  1) Use a memory heap that is host coherent, indicated with
-  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+  VkDescriptorPoolSize poolSize{
+      .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      .descriptorCount = 4 * MAX_FRAMES_IN_FLIGHT,
+  };
+  VkDescriptorPoolCreateInfo poolInfo{
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .maxSets = MAX_FRAMES_IN_FLIGHT,
+      .poolSizeCount = 1,
+      .pPoolSizes = &poolSize,
+  };
 
-  2) Call vkFlushMappedMemoryRanges after writing to the mapped memory, and call
-  vkInvalidateMappedMemoryRanges before reading from the mapped memory
-  */
-  memcpy(data, vertices.data(), (size_t)bufferSize);
-  vkUnmapMemory(device, stagingBufferMemory);
+  if (vkCreateDescriptorPool(device, &poolInfo, nullptr,
+                             &cullDescriptorPool) != VK_SUCCESS)
+    throw std::runtime_error("failed to create descriptor pool!");
 
-  createBuffer(device, physicalDevice, bufferSize,
-               VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-                   VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-               vertexBuffer, vertexBufferMemory);
+  std::vector<VkDescriptorSetLayout> setLayouts(MAX_FRAMES_IN_FLIGHT,
+                                                cullSetLayout);
+  VkDescriptorSetAllocateInfo allocInfo{
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+      .pNext = nullptr,
+      .descriptorPool = cullDescriptorPool,
+      .descriptorSetCount = MAX_FRAMES_IN_FLIGHT,
+      .pSetLayouts = setLayouts.data(),
+  };
 
-  copyBuffer(device, commandPool, qGraphics, stagingBuffer,
-             vertexBuffer, bufferSize);
+  cullDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+  if (vkAllocateDescriptorSets(device, &allocInfo,
+                               cullDescriptorSets.data()) != VK_SUCCESS)
+    throw std::runtime_error("failed to allocate descriptor sets!");
 
-  vkDestroyBuffer(device, stagingBuffer, nullptr);
-  vkFreeMemory(device, stagingBufferMemory, nullptr);
+  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+  {
+    VkDescriptorBufferInfo bufferInfos[] = {
+        {drawBoundsBuffer, 0, VK_WHOLE_SIZE},
+        {drawCommandBuffer, 0, VK_WHOLE_SIZE},
+        {visibleDrawBuffers[i], 0, VK_WHOLE_SIZE},
+        {visibleCountBuffers[i], 0, VK_WHOLE_SIZE},
+    };
+    VkWriteDescriptorSet write{
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .pNext = nullptr,
+        .dstSet = cullDescriptorSets[i],
+        .dstBinding = 0,
+        .dstArrayElement = 0,
+        // Consecutive bindings of the same type are written at once
+        .descriptorCount = 4,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pImageInfo = nullptr,
+        .pBufferInfo = bufferInfos,
+        .pTexelBufferView = nullptr,
+    };
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+  }
 }
 
-void HelloTriangleApplication::createIndexBuffer()
+void HelloTriangleApplication::recordCulling(VkCommandBuffer commandBuffer)
 {
-  VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+  VkBuffer visibleDraws = visibleDrawBuffers[currentFrame];
+  VkBuffer visibleCount = visibleCountBuffers[currentFrame];
 
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingBufferMemory;
-  createBuffer(device, physicalDevice, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+  // The culling pass counts the visible draws up from 0
+  vkCmdFillBuffer(commandBuffer, visibleCount, 0, sizeof(uint32_t), 0);
+  VkBufferMemoryBarrier countCleared{
+      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+      .pNext = nullptr,
+      .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .buffer = visibleCount,
+      .offset = 0,
+      .size = VK_WHOLE_SIZE,
+  };
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1,
+                       &countCleared, 0, nullptr);
+
+  // The view is the clip space, where the shaders place the instances
+  CullConstants constants{
+      .planes =
+          {
+              {1.0f, 0.0f, 0.0f, 1.0f},
+              {-1.0f, 0.0f, 0.0f, 1.0f},
+              {0.0f, 1.0f, 0.0f, 1.0f},
+              {0.0f, -1.0f, 0.0f, 1.0f},
+          },
+      .objectCount = config.drawCount,
+      .compact = drawIndirectCountSupported,
+  };
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    cullPipeline);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          cullPipelineLayout, 0, 1,
+                          &cullDescriptorSets[currentFrame], 0, nullptr);
+  vkCmdPushConstants(commandBuffer, cullPipelineLayout,
+                     VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                     &constants);
+  vkCmdDispatch(commandBuffer,
+                (config.drawCount + CULL_WORKGROUP_SIZE - 1) /
+                    CULL_WORKGROUP_SIZE,
+                1, 1);
+
+  VkBufferMemoryBarrier culled[] = {countCleared, countCleared};
+  for (auto &barrier : culled)
+  {
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+  }
+  culled[0].buffer = visibleDraws;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 0, nullptr, 2,
+                       culled, 0, nullptr);
+}
 
-  void *data;
-  vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-  memcpy(data, indices.data(), (size_t)bufferSize);
-  vkUnmapMemory(device, stagingBufferMemory);
+void HelloTriangleApplication::createInstanceBuffers()
+{
+  VkDeviceSize bufferSize =
+      static_cast<VkDeviceSize>(config.instanceCount) * sizeof(InstanceData);
+  instanceBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+  instanceBufferAllocations.resize(MAX_FRAMES_IN_FLIGHT);
+  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    createBuffer(device, allocator, bufferSize,
+                 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, MemoryUsage::Dynamic,
+                 instanceBuffers[i], instanceBufferAllocations[i]);
+}
 
-  createBuffer(device, physicalDevice, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+void HelloTriangleApplication::updateInstances(uint32_t frame)
+{
+  uint32_t instanceCount = config.instanceCount;
+  InstanceGrid grid = instanceGrid(instanceCount, config.sceneExtent);
+  auto *instances =
+      static_cast<InstanceData *>(instanceBufferAllocations[frame].mapped);
 
-  copyBuffer(device, commandPool, qGraphics, stagingBuffer, indexBuffer, bufferSize);
+  std::vector<std::future<void>> tasks;
+  for (uint32_t first = 0; first < instanceCount; first += INSTANCES_PER_TASK)
+  {
+    uint32_t count = std::min(INSTANCES_PER_TASK, instanceCount - first);
+    tasks.push_back(workers.submit(
+        [instances, first, count, grid, frameNumber = frameNumber]
+        { writeInstances(instances, first, count, grid, frameNumber); }));
+  }
+  // Every task must be done writing before an error is rethrown
+  for (auto &task : tasks)
+    task.wait();
+  for (auto &task : tasks)
+    task.get();
 
-  vkDestroyBuffer(device, stagingBuffer, nullptr);
-  vkFreeMemory(device, stagingBufferMemory, nullptr);
+  allocator.flush(instanceBufferAllocations[frame]);
 }
 
 void HelloTriangleApplication::createCommandBuffers()
 {
-  commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-  VkCommandBufferAllocateInfo allocInfo{
-      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-      .pNext = nullptr,
-      .commandPool = commandPool,
-      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-      .commandBufferCount = static_cast<uint32_t>(commandBuffers.size()),
-  };
+  commandBuffers.init(device, commandPool, MAX_FRAMES_IN_FLIGHT,
+                      static_cast<uint32_t>(swapChainImages.size()));
 
-  if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) !=
-      VK_SUCCESS)
-    throw std::runtime_error("failed to allocate command buffers!");
+  QueueFamilyIndices queueFamilyIndices =
+      findQueueFamilies(physicalDevice, surface, VK_QUEUE_GRAPHICS_BIT);
+  parallelRecorder.init(device, queueFamilyIndices.graphicsFamily.value(),
+                        workers, MAX_FRAMES_IN_FLIGHT,
+                        static_cast<uint32_t>(swapChainImages.size()),
+                        config.recordThreads);
 }
 
 void HelloTriangleApplication::recordCommandBuffer(
@@ -609,73 +1293,356 @@ void HelloTriangleApplication::recordCommandBuffer(
   if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
     throw std::runtime_error("failed to begin recording command buffer!");
 
+  VkQueryPool queryPool = timestampQueryPools.empty()
+                              ? VK_NULL_HANDLE
+                              : timestampQueryPools[currentFrame];
+  if (queryPool != VK_NULL_HANDLE)
+  {
+    // Queries must be reset before they are written again, and resetting
+    // is not allowed inside a render pass
+    vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+  }
+
+  // Compute work is not allowed inside a render pass
+  if (gpuCullingSupported)
+    recordCulling(commandBuffer);
+
+  // Written after the culling so that gpu_render_pass_ms only measures the
+  // render pass
+  if (queryPool != VK_NULL_HANDLE)
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                        queryPool, 0);
+
+  if (parallelRecorder.threadCount() == 0 || indirectDrawsSupported)
+  {
+    beginRendering(commandBuffer, imageIndex, false);
+    recordDraws(commandBuffer, 0, config.drawCount);
+  }
+  else
+  {
+    beginRendering(commandBuffer, imageIndex, true);
+    // Secondary command buffers executed inside dynamic rendering only
+    // inherit the formats of the attachments
+    VkCommandBufferInheritanceRenderingInfo renderingInheritance{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .viewMask = 0,
+        .colorAttachmentCount = 1,
+        .pColorAttachmentFormats = &swapChainImageFormat,
+        .depthAttachmentFormat = VK_FORMAT_UNDEFINED,
+        .stencilAttachmentFormat = VK_FORMAT_UNDEFINED,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+    };
+    VkCommandBufferInheritanceInfo inheritance{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .pNext = dynamicRenderingSupported ? &renderingInheritance : nullptr,
+        .renderPass = renderPass,
+        .subpass = 0,
+        .framebuffer = dynamicRenderingSupported
+                           ? VK_NULL_HANDLE
+                           : swapChainFramebuffers[imageIndex],
+    };
+    parallelRecorder.record(
+        commandBuffer, currentFrame, imageIndex, inheritance, config.drawCount,
+        [this](VkCommandBuffer secondary, uint32_t firstDraw,
+               uint32_t drawCount)
+        { recordDraws(secondary, firstDraw, drawCount); });
+  }
+  endRendering(commandBuffer, imageIndex);
+
+  if (queryPool != VK_NULL_HANDLE)
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        queryPool, 1);
+
+  // The visible draws are counted on the CPU once the frame has completed.
+  // Waiting for the submission does not make the writes of the culling pass
+  // visible to the host, the barrier does.
+  if (gpuCullingSupported)
+  {
+    VkBufferMemoryBarrier countReadback{
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask =
+            VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = visibleCountBuffers[currentFrame],
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    };
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT |
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1,
+                         &countReadback, 0, nullptr);
+  }
+
+  if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+    throw std::runtime_error("failed to record command buffer!");
+}
+
+void HelloTriangleApplication::beginRendering(VkCommandBuffer commandBuffer,
+                                              uint32_t imageIndex,
+                                              bool secondaries)
+{
   VkClearValue clearColor{
       .color =
           {
               .float32 = {0.0f, 0.0f, 0.0f, 1.0f},
           },
   };
-  VkRenderPassBeginInfo renderPassInfo{
-      .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+  VkRect2D renderArea{
+      .offset = {0, 0},
+      .extent = swapChainExtent,
+  };
+
+  if (!dynamicRenderingSupported)
+  {
+    VkRenderPassBeginInfo renderPassInfo{
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+        .pNext = nullptr,
+        .renderPass = renderPass,
+        .framebuffer = swapChainFramebuffers[imageIndex],
+        .renderArea = renderArea,
+        .clearValueCount = 1,
+        .pClearValues = &clearColor};
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                         secondaries
+                             ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+                             : VK_SUBPASS_CONTENTS_INLINE);
+    return;
+  }
+
+  // What the initial layout and the subpass dependency of the render pass
+  // do: the previous contents are discarded, and the transition waits for
+  // the same stage as the acquire semaphore
+  VkImageMemoryBarrier toAttachment{
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
       .pNext = nullptr,
-      .renderPass = renderPass,
-      .framebuffer = swapChainFramebuffers[imageIndex],
-      .renderArea =
-          {
-              .offset = {0, 0},
-              .extent = swapChainExtent,
-          },
-      .clearValueCount = 1,
-      .pClearValues = &clearColor};
+      .srcAccessMask = 0,
+      .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+      .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+      .newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = swapChainImages[imageIndex],
+      .subresourceRange = COLOR_SUBRESOURCE_RANGE,
+  };
+  vkCmdPipelineBarrier(commandBuffer,
+                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0,
+                       nullptr, 0, nullptr, 1, &toAttachment);
 
-  vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
-                       VK_SUBPASS_CONTENTS_INLINE);
-  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                    graphicsPipeline);
+  VkRenderingAttachmentInfo colorAttachment{
+      .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+      .pNext = nullptr,
+      .imageView = swapChainImageViews[imageIndex],
+      .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+      .resolveMode = VK_RESOLVE_MODE_NONE,
+      .resolveImageView = VK_NULL_HANDLE,
+      .resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+      .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+      .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+      .clearValue = clearColor,
+  };
+  VkRenderingInfo renderingInfo{
+      .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+      .pNext = nullptr,
+      .flags = secondaries
+                   ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT
+                   : 0u,
+      .renderArea = renderArea,
+      .layerCount = 1,
+      .viewMask = 0,
+      .colorAttachmentCount = 1,
+      .pColorAttachments = &colorAttachment,
+      .pDepthAttachment = nullptr,
+      .pStencilAttachment = nullptr,
+  };
+  vkCmdBeginRendering(commandBuffer, &renderingInfo);
+}
 
-  VkViewport viewport{
-      .x = 0.0f,
-      .y = 0.0f,
-      .width = static_cast<float>(swapChainExtent.width),
-      .height = static_cast<float>(swapChainExtent.height),
-      .minDepth = 0.0f,
-      .maxDepth = 1.0f,
+void HelloTriangleApplication::endRendering(VkCommandBuffer commandBuffer,
+                                            uint32_t imageIndex)
+{
+  if (!dynamicRenderingSupported)
+  {
+    vkCmdEndRenderPass(commandBuffer);
+    return;
+  }
+
+  vkCmdEndRendering(commandBuffer);
+
+  // What the final layout of the render pass does. Offscreen images are
+  // read by a later submission, which waits for this one to complete.
+  VkImageMemoryBarrier toFinal{
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+      .pNext = nullptr,
+      .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+      .dstAccessMask = 0,
+      .oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+      .newLayout = config.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                   : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = swapChainImages[imageIndex],
+      .subresourceRange = COLOR_SUBRESOURCE_RANGE,
   };
-  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+  vkCmdPipelineBarrier(commandBuffer,
+                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                       VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &toFinal);
+}
 
-  VkRect2D scissor{
-      .offset = {0, 0},
-      .extent = swapChainExtent,
+void HelloTriangleApplication::recordDraws(VkCommandBuffer commandBuffer,
+                                           uint32_t firstDraw,
+                                           uint32_t drawCount) const
+{
+  if (drawCount == 0)
+    return;
+
+  // The static pipeline only fits the extent it was created with, after a
+  // resize the viewport and the scissor are set dynamically instead
+  bool staticExtent = swapChainExtent.width == staticPipelineExtent.width &&
+                      swapChainExtent.height == staticPipelineExtent.height;
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                    staticExtent ? graphicsPipeline : dynamicViewportPipeline);
+
+  if (!staticExtent)
+  {
+    VkViewport viewport{
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = static_cast<float>(swapChainExtent.width),
+        .height = static_cast<float>(swapChainExtent.height),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f,
+    };
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{
+        .offset = {0, 0},
+        .extent = swapChainExtent,
+    };
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+  }
+
+  // Every mesh is drawn from the same two buffers
+  geometry.bind(commandBuffer);
+  if (config.instanceCount > 0)
+  {
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(commandBuffer, 1, 1, &instanceBuffers[currentFrame],
+                           &offset);
+  }
+
+  if (indirectDrawsSupported)
+  {
+    // With culling, the draws and their number come from the culling pass
+    VkBuffer draws = gpuCullingSupported ? visibleDrawBuffers[currentFrame]
+                                         : drawCommandBuffer;
+    VkBuffer count = gpuCullingSupported ? visibleCountBuffers[currentFrame]
+                                         : drawCountBuffer;
+    VkDeviceSize offset = firstDraw * sizeof(VkDrawIndexedIndirectCommand);
+    if (drawIndirectCountSupported)
+      vkCmdDrawIndexedIndirectCount(commandBuffer, draws, offset, count, 0,
+                                    drawCount,
+                                    sizeof(VkDrawIndexedIndirectCommand));
+    else
+      vkCmdDrawIndexedIndirect(commandBuffer, draws, offset, drawCount,
+                               sizeof(VkDrawIndexedIndirectCommand));
+    return;
+  }
+
+  for (uint32_t draw = firstDraw; draw < firstDraw + drawCount; draw++)
+  {
+    VkDrawIndexedIndirectCommand command = drawCommand(draw);
+    if (command.instanceCount > 0)
+      vkCmdDrawIndexed(commandBuffer, command.indexCount,
+                       command.instanceCount, command.firstIndex,
+                       command.vertexOffset, command.firstInstance);
+  }
+}
+
+VkDrawIndexedIndirectCommand
+HelloTriangleApplication::drawCommand(uint32_t draw) const
+{
+  VkDrawIndexedIndirectCommand command{
+      .indexCount = quadMesh.indexCount,
+      .instanceCount = 1,
+      .firstIndex = quadMesh.firstIndex,
+      .vertexOffset = quadMesh.baseVertex,
+      // Every draw renders the same mesh, the draw index is passed as the
+      // instance index
+      .firstInstance = draw,
   };
-  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-  VkBuffer vertexBuffers[] = {vertexBuffer};
-  VkDeviceSize offsets[] = {0};
-  vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-  vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+  uint64_t instanceCount = config.instanceCount;
+  if (instanceCount > 0)
+  {
+    uint32_t first =
+        static_cast<uint32_t>(instanceCount * draw / config.drawCount);
+    uint32_t last =
+        static_cast<uint32_t>(instanceCount * (draw + 1) / config.drawCount);
+    command.instanceCount = last - first;
+    command.firstInstance = first;
+  }
 
-  vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
-  vkCmdEndRenderPass(commandBuffer);
+  return command;
+}
 
-  if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
-    throw std::runtime_error("failed to record command buffer!");
+void HelloTriangleApplication::createIndirectBuffers()
+{
+  VkDeviceSize bufferSize =
+      sizeof(VkDrawIndexedIndirectCommand) * config.drawCount;
+  StagingRegion staging = stagingRing.allocate(bufferSize);
+  auto *commands = static_cast<VkDrawIndexedIndirectCommand *>(staging.mapped);
+  for (uint32_t draw = 0; draw < config.drawCount; draw++)
+    commands[draw] = drawCommand(draw);
+
+  StagingRegion countStaging = stagingRing.allocate(sizeof(uint32_t));
+  memcpy(countStaging.mapped, &config.drawCount, sizeof(uint32_t));
+  stagingRing.flush();
+
+  createBuffer(device, allocator, bufferSize,
+               VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                   VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+               MemoryUsage::GpuOnly, drawCommandBuffer,
+               drawCommandBufferAllocation);
+  createBuffer(device, allocator, sizeof(uint32_t),
+               VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                   VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+               MemoryUsage::GpuOnly, drawCountBuffer,
+               drawCountBufferAllocation);
+
+  uploads.copyBuffer(staging.buffer, staging.offset, drawCommandBuffer, 0,
+                     bufferSize, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                     VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+  uploads.copyBuffer(countStaging.buffer, countStaging.offset,
+                     drawCountBuffer, 0, sizeof(uint32_t),
+                     VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                     VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
 }
 
 void HelloTriangleApplication::createSyncObjects()
 {
   imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
   renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-  inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+  // Serial 0 is always complete, so the first frame in every slot does not
+  // wait
+  frameSerials.assign(MAX_FRAMES_IN_FLIGHT, 0);
+  frameStartTimes.resize(MAX_FRAMES_IN_FLIGHT);
+  frameDepths.assign(MAX_FRAMES_IN_FLIGHT, 0);
+  frameProfiles.assign(MAX_FRAMES_IN_FLIGHT, presentProfile);
+  latencyPending.assign(MAX_FRAMES_IN_FLIGHT, false);
+  adaptiveDepth.init(MIN_FRAMES_IN_FLIGHT, MAX_FRAMES_IN_FLIGHT);
 
   VkSemaphoreCreateInfo semaphoreInfo{
       .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
       .pNext = nullptr,
   };
-  VkFenceCreateInfo fenceInfo{
-      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-      .pNext = nullptr,
-      .flags = VK_FENCE_CREATE_SIGNALED_BIT,
-  };
 
   for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
   {
@@ -686,56 +1653,353 @@ void HelloTriangleApplication::createSyncObjects()
     if (vkCreateSemaphore(device, &semaphoreInfo, nullptr,
                           &renderFinishedSemaphores[i]) != VK_SUCCESS)
       throw std::runtime_error("failed to create render finished semaphore!");
+  }
+}
 
-    if (vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) !=
-        VK_SUCCESS)
-      throw std::runtime_error("failed to create in flight fence!");
+void HelloTriangleApplication::createTimestampQueries()
+{
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+  uint32_t graphicsFamily =
+      findQueueFamilies(physicalDevice, surface, VK_QUEUE_GRAPHICS_BIT)
+          .graphicsFamily.value();
+  uint32_t queueFamilyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount,
+                                           nullptr);
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount,
+                                           queueFamilies.data());
+
+  // A value of 0 means that the queue does not support timestamps
+  uint32_t validBits = queueFamilies[graphicsFamily].timestampValidBits;
+  if (validBits == 0)
+  {
+    std::cout << "Timestamps not supported, GPU times will not be measured"
+              << std::endl;
+    return;
   }
+
+  timestampMask = validBits >= 64 ? UINT64_MAX : (1ULL << validBits) - 1;
+  timestampPeriod = properties.limits.timestampPeriod;
+
+  VkQueryPoolCreateInfo queryPoolInfo{
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .pNext = nullptr,
+      .queryType = VK_QUERY_TYPE_TIMESTAMP,
+      .queryCount = 2, // start and end of the render pass
+  };
+
+  timestampQueryPools.resize(MAX_FRAMES_IN_FLIGHT);
+  timestampsWritten.assign(MAX_FRAMES_IN_FLIGHT, false);
+  for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+  {
+    if (vkCreateQueryPool(device, &queryPoolInfo, nullptr,
+                          &timestampQueryPools[i]) != VK_SUCCESS)
+      throw std::runtime_error("failed to create timestamp query pool!");
+  }
+}
+
+void HelloTriangleApplication::collectTimestamps(uint32_t frame)
+{
+  if (timestampQueryPools.empty() || !timestampsWritten[frame])
+    return;
+
+  // Every query is followed by its availability, so a result that is not
+  // ready yet is skipped instead of waited for (no VK_QUERY_RESULT_WAIT_BIT)
+  uint64_t results[4];
+  VkResult result = vkGetQueryPoolResults(
+      device, timestampQueryPools[frame], 0, 2, sizeof(results), results,
+      2 * sizeof(uint64_t),
+      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+  timestampsWritten[frame] = false;
+
+  if (result != VK_SUCCESS || results[1] == 0 || results[3] == 0)
+    return;
+
+  // Only the low validBits of a timestamp are meaningful, the masked
+  // difference is also correct when the counter wrapped around in between
+  uint64_t ticks = (results[2] - results[0]) & timestampMask;
+  benchmark.addSample("gpu_render_pass_ms",
+                      ticks * static_cast<double>(timestampPeriod) / 1e6);
 }
 
 void HelloTriangleApplication::draw()
 {
-  vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE,
-                  UINT64_MAX);
+  auto frameStart = Benchmark::Clock::now();
+  // The frame framesInFlight frames ago and the last one of this slot
+  uint64_t depthSerial =
+      frameNumber >= framesInFlight
+          ? recentFrameSerials[(frameNumber - framesInFlight) %
+                               MAX_FRAMES_IN_FLIGHT]
+          : 0;
+  graphicsSubmissions.wait(std::max(frameSerials[currentFrame], depthSerial));
+  lastWaitMilliseconds = std::chrono::duration<double, std::milli>(
+                             Benchmark::Clock::now() - frameStart)
+                             .count();
+  benchmark.addSample("fence_wait_ms", lastWaitMilliseconds);
+  // The slot's last frame has completed, so its culling pass has counted
+  // the draws that were visible
+  if (gpuCullingSupported && drawIndirectCountSupported &&
+      frameSerials[currentFrame] != 0)
+  {
+    allocator.invalidate(visibleCountBufferAllocations[currentFrame]);
+    benchmark.addSample(
+        "visible_draws",
+        *static_cast<const uint32_t *>(
+            visibleCountBufferAllocations[currentFrame].mapped));
+  }
+  collectLatencies();
+  deletionQueue.collect();
+  collectTimestamps(currentFrame);
   uint32_t imageIndex;
 
-  VkResult result = vkAcquireNextImageKHR(
-      device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame],
-      VK_NULL_HANDLE, &imageIndex);
-
-  if (result == VK_ERROR_OUT_OF_DATE_KHR)
+  if (config.headless)
   {
-    recreateSwapChain();
-    return;
+    // Every frame slot owns its offscreen image, so the frame waited for above
+    // also guarantees that the image is no longer in use
+    imageIndex = currentFrame;
+  }
+  else
+  {
+    // Earlier frames the GPU has yet to finish, and so to present
+    lastQueuedFrames = 0;
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+      if (i != currentFrame && !graphicsSubmissions.completed(frameSerials[i]))
+        lastQueuedFrames++;
+    benchmark.addSample("queued_frames", lastQueuedFrames);
+
+    auto acquireStart = Benchmark::Clock::now();
+    VkResult result = vkAcquireNextImageKHR(
+        device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame],
+        VK_NULL_HANDLE, &imageIndex);
+    lastAcquireMilliseconds = std::chrono::duration<double, std::milli>(
+                                  Benchmark::Clock::now() - acquireStart)
+                                  .count();
+    benchmark.addSample("acquire_ms", lastAcquireMilliseconds);
+    benchmark.addSample("acquire_ms_images" +
+                            std::to_string(swapChainImageCount),
+                        lastAcquireMilliseconds);
+
+    if (result == VK_ERROR_OUT_OF_DATE_KHR)
+    {
+      recreateSwapChain();
+      return;
+    }
+    else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+    {
+      throw std::runtime_error("failed to acquire swap chain image!");
+    }
   }
-  else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+
+  // The instance buffer of the slot is bound by its command buffers, so
+  // rewriting it does not invalidate them
+  if (config.instanceCount > 0)
   {
-    throw std::runtime_error("failed to acquire swap chain image!");
+    auto timer = benchmark.time("instance_update_ms");
+    updateInstances(currentFrame);
   }
 
-  vkResetFences(device, 1, &inFlightFences[currentFrame]);
+  // Without reuse every frame counts as a new scene
+  if (!config.reuseCommandBuffers)
+    sceneVersion++;
 
-  vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-  recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+  VkCommandBuffer commandBuffer;
+  {
+    auto timer = benchmark.time("record_ms");
+    bool upToDate;
+    commandBuffer =
+        commandBuffers.get(currentFrame, imageIndex, sceneVersion, upToDate);
+    if (!upToDate)
+      recordCommandBuffer(commandBuffer, imageIndex);
+  }
 
+  // Without a swap chain there is no image to wait for and no presentation
+  // that waits for the rendering, so no semaphores are used in headless mode
+  uint32_t semaphoreCount = config.headless ? 0 : 1;
   VkPipelineStageFlags waitStages[] = {
       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
   };
   VkSubmitInfo submitInfo{
       .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
       .pNext = nullptr,
-      .waitSemaphoreCount = 1,
+      .waitSemaphoreCount = semaphoreCount,
       .pWaitSemaphores = &imageAvailableSemaphores[currentFrame],
       .pWaitDstStageMask = waitStages,
       .commandBufferCount = 1,
-      .pCommandBuffers = &commandBuffers[currentFrame],
-      .signalSemaphoreCount = 1,
+      .pCommandBuffers = &commandBuffer,
+      .signalSemaphoreCount = semaphoreCount,
       .pSignalSemaphores = &renderFinishedSemaphores[currentFrame]};
 
-  if (vkQueueSubmit(qGraphics, 1, &submitInfo, inFlightFences[currentFrame]) !=
-      VK_SUCCESS)
-    throw std::runtime_error("failed to submit draw command buffer!");
+  {
+    auto timer = benchmark.time("submit_ms");
+    frameSerials[currentFrame] = graphicsSubmissions.submit(1, &submitInfo);
+  }
+  // Uploads recorded into this frame are done with their staging space once
+  // the frame completes
+  stagingRing.retire(frameSerials[currentFrame]);
+  recentFrameSerials[frameNumber++ % MAX_FRAMES_IN_FLIGHT] =
+      frameSerials[currentFrame];
+  if (!timestampQueryPools.empty())
+    timestampsWritten[currentFrame] = true;
+  if (benchmark.enabled)
+  {
+    frameStartTimes[currentFrame] = frameStart;
+    frameDepths[currentFrame] = framesInFlight;
+    frameProfiles[currentFrame] = presentProfile;
+    latencyPending[currentFrame] = true;
+  }
+
+  lastImageIndex = imageIndex;
+
+  if (!config.headless)
+  {
+    auto timer = benchmark.time("present_ms");
+    present(imageIndex);
+  }
+
+  currentFrame = (currentFrame + 1) % framesInFlight;
+}
+
+void HelloTriangleApplication::collectLatencies()
+{
+  auto now = Benchmark::Clock::now();
+  for (uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++)
+  {
+    if (!latencyPending[frame] ||
+        !graphicsSubmissions.completed(frameSerials[frame]))
+      continue;
+
+    double latency = std::chrono::duration<double, std::milli>(
+                         now - frameStartTimes[frame])
+                         .count();
+    benchmark.addSample("latency_ms", latency);
+    benchmark.addSample("latency_ms_depth" +
+                            std::to_string(frameDepths[frame]),
+                        latency);
+    benchmark.addSample(std::string("latency_ms_") +
+                            presentProfileName(frameProfiles[frame]),
+                        latency);
+    latencyPending[frame] = false;
+  }
+}
 
+void HelloTriangleApplication::limitFrameRate(
+    Benchmark::Clock::time_point frameStart)
+{
+  uint32_t frameCap = presentProfileFrameCap(presentProfile, config.frameCap);
+  if (frameCap == 0)
+    return;
+
+  auto timer = benchmark.time("frame_cap_sleep_ms");
+  std::this_thread::sleep_until(
+      frameStart + std::chrono::duration_cast<Benchmark::Clock::duration>(
+                       std::chrono::duration<double>(1.0 / frameCap)));
+}
+
+void HelloTriangleApplication::updatePresentProfile(
+    Benchmark::Clock::time_point frameStart)
+{
+  double frameMilliseconds = std::chrono::duration<double, std::milli>(
+                                 Benchmark::Clock::now() - frameStart)
+                                 .count();
+  benchmark.addSample(std::string("frame_ms_") +
+                          presentProfileName(presentProfile),
+                      frameMilliseconds);
+
+  PresentProfile profile = presentProfile;
+  size_t profileCount = std::size(PRESENT_PROFILES);
+  if (config.benchmarkProfileSweep)
+  {
+    size_t index = std::min<size_t>(benchmark.measuredFrames() * profileCount /
+                                        config.benchmarkFrames,
+                                    profileCount - 1);
+    profile = PRESENT_PROFILES[index];
+  }
+  else if (presentProfileRequested)
+  {
+    presentProfileRequested = false;
+    profile = PRESENT_PROFILES[(static_cast<size_t>(presentProfile) + 1) %
+                               profileCount];
+  }
+
+  if (profile == presentProfile)
+    return;
+
+  presentProfile = profile;
+  // Without a swap chain only the frame cap of the profile matters
+  if (config.headless)
+    return;
+
+  std::string title =
+      std::string(APP_NAME) + " - " + presentProfileName(presentProfile);
+  glfwSetWindowTitle(window, title.c_str());
+
+  VkPresentModeKHR presentMode = chooseSwapPresentMode(
+      querySwapChainSupport(physicalDevice, surface).presentModes,
+      presentProfile);
+  if (presentMode != swapChainPresentMode)
+    recreateSwapChain();
+}
+
+void HelloTriangleApplication::updateSwapChainImageCount()
+{
+  if (config.headless || !config.adaptiveSwapchainImages)
+    return;
+
+  uint32_t imageCount = adaptiveImages.update(
+      swapChainImageCount, lastAcquireMilliseconds, lastQueuedFrames);
+  if (imageCount != swapChainImageCount)
+  {
+    swapChainImageCount = imageCount;
+    recreateSwapChain();
+  }
+}
+
+void HelloTriangleApplication::updateFramesInFlight(
+    Benchmark::Clock::time_point frameStart)
+{
+  double frameMilliseconds = std::chrono::duration<double, std::milli>(
+                                 Benchmark::Clock::now() - frameStart)
+                                 .count();
+  benchmark.addSample("frame_ms_depth" + std::to_string(framesInFlight),
+                      frameMilliseconds);
+
+  uint32_t depth = framesInFlight;
+  if (config.benchmarkDepthSweep)
+  {
+    uint32_t depthCount = MAX_FRAMES_IN_FLIGHT - MIN_FRAMES_IN_FLIGHT + 1;
+    depth = std::min(MIN_FRAMES_IN_FLIGHT +
+                         benchmark.measuredFrames() * depthCount /
+                             config.benchmarkFrames,
+                     MAX_FRAMES_IN_FLIGHT);
+  }
+  else if (requestedFramesInFlight != 0)
+  {
+    depth = requestedFramesInFlight;
+    adaptiveFramesInFlight = false;
+    requestedFramesInFlight = 0;
+  }
+  else if (adaptiveRequested)
+  {
+    adaptiveFramesInFlight = true;
+    adaptiveRequested = false;
+  }
+  else if (adaptiveFramesInFlight)
+  {
+    depth = adaptiveDepth.update(framesInFlight, lastWaitMilliseconds,
+                                 frameMilliseconds - lastWaitMilliseconds);
+  }
+
+  if (depth != framesInFlight)
+  {
+    framesInFlight = depth;
+    currentFrame %= framesInFlight;
+  }
+}
+
+void HelloTriangleApplication::present(uint32_t imageIndex)
+{
   VkSwapchainKHR swapChains[] = {swapChain};
   VkPresentInfoKHR presentInfo{
       .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
@@ -748,7 +2012,7 @@ void HelloTriangleApplication::draw()
       .pResults = nullptr, // Optional
   };
 
-  result = vkQueuePresentKHR(qPresentation, &presentInfo);
+  VkResult result = vkQueuePresentKHR(qPresentation, &presentInfo);
   if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
       framebufferResized)
   {
@@ -759,8 +2023,6 @@ void HelloTriangleApplication::draw()
   {
     throw std::runtime_error("failed to present swap chain image!");
   }
-
-  currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
 void HelloTriangleApplication::recreateSwapChain()
@@ -773,10 +2035,23 @@ void HelloTriangleApplication::recreateSwapChain()
     glfwWaitEvents();
   }
 
-  vkDeviceWaitIdle(device);
+  // Frames in flight keep rendering to the images of the old swap chain, so
+  // its resources live until the last of them has completed
+  uint64_t lastUse = graphicsSubmissions.lastSubmitted();
+  for (auto framebuffer : swapChainFramebuffers)
+    deletionQueue.enqueue(framebuffer, lastUse);
+  for (auto imageView : swapChainImageViews)
+    deletionQueue.enqueue(imageView, lastUse);
+  deletionQueue.enqueue(swapChain, lastUse);
+  swapChainFramebuffers.clear();
+  swapChainImageViews.clear();
 
-  cleanupSwapchain();
   createSwapChain();
   createImageViews();
-  createFramebuffers();
+  if (!dynamicRenderingSupported)
+    createFramebuffers();
+  // The recorded commands refer to the old framebuffers or image views
+  commandBuffers.invalidate(static_cast<uint32_t>(swapChainImages.size()));
+  parallelRecorder.invalidate(static_cast<uint32_t>(swapChainImages.size()));
 }
+
@@ -1,55 +1,216 @@
 #pragma once
 #define GLFW_INCLUDE_VULKAN
+#include "AdaptiveFrameDepth.h"
+#include "AdaptiveImageCount.h"
+#include "Benchmark.h"
+#include "CommandBufferCache.h"
+#include "Config.h"
 #include "DebugUtils.h"
+#include "DeletionQueue.h"
+#include "GeometryPool.h"
+#include "Memory.h"
+#include "PipelineCache.h"
+#include "ParallelRecorder.h"
+#include "PipelineCompiler.h"
+#include "StagingRing.h"
+#include "SubmissionTracker.h"
+#include "TransferQueue.h"
 #include <GLFW/glfw3.h>
+#include <array>
+#include <glm/glm.hpp>
 #include <vector>
 
 inline const uint32_t WIDTH = 800;
 inline const uint32_t HEIGHT = 600;
-inline const int MAX_FRAMES_IN_FLIGHT = 2;
 inline const char *APP_NAME = "Hello Triangle";
+// Color format of the images rendered in headless mode.
+inline const VkFormat OFFSCREEN_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
 
 class HelloTriangleApplication
 {
 public:
   bool framebufferResized = false;
+  // Set by the key callback, applied before the next frame: a depth of
+  // frames in flight, 0 for none, or a switch to the adaptive depth
+  uint32_t requestedFramesInFlight = 0;
+  bool adaptiveRequested = false;
+  // Set by the key callback: switch to the next present profile
+  bool presentProfileRequested = false;
+
+  explicit HelloTriangleApplication(const AppConfig &config = AppConfig{})
+      : config(config), framesInFlight(config.framesInFlight),
+        adaptiveFramesInFlight(config.adaptiveFramesInFlight),
+        presentProfile(config.presentProfile),
+        swapChainImageCount(config.swapchainImages)
+  {
+    benchmark.enabled = config.benchmarkFrames > 0;
+  }
 
   void run()
   {
-    initWindow();
+    if (!config.headless)
+      initWindow();
+    auto start = Benchmark::Clock::now();
     initVulkan();
+    startupMilliseconds = std::chrono::duration<double, std::milli>(
+                              Benchmark::Clock::now() - start)
+                              .count();
     mainLoop();
+    if (config.headless && !config.screenshotPath.empty())
+      saveScreenshot(config.screenshotPath);
+    if (benchmark.enabled)
+      writeBenchmarkResults();
+    if (!config.pipelineCachePath.empty())
+      savePipelineCache(device, pipelineCache, config.pipelineCachePath);
     cleanup();
   }
 
 private:
-  GLFWwindow *window;
+  AppConfig config;
+  Benchmark benchmark;
+  GLFWwindow *window = nullptr;
   VkInstance instance;
   VkDebugUtilsMessengerEXT debugMessenger;
   VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
   VkDevice device;
-  VkSurfaceKHR surface;
+  MemoryAllocator allocator;
+  // VK_EXT_memory_budget is enabled, see createLogicalDevice()
+  bool memoryBudgetSupported = false;
+  // Submissions are tracked with timeline semaphores instead of fences
+  bool timelineSemaphoresSupported = false;
+  // Rendering begins directly on the image views (Vulkan 1.3), without a
+  // render pass and framebuffers
+  bool dynamicRenderingSupported = false;
+  // The draws are issued from drawCommandBuffer, with the draw count read
+  // from drawCountBuffer when the device supports it (Vulkan 1.2)
+  bool indirectDrawsSupported = false;
+  bool drawIndirectCountSupported = false;
+  // A compute pass culls the indirect draws before they are drawn
+  bool gpuCullingSupported = false;
+  VkSurfaceKHR surface = VK_NULL_HANDLE;
   VkQueue qGraphics;
   VkQueue qPresentation;
-  VkSwapchainKHR swapChain;
+  // Every submission to qGraphics goes through the tracker
+  SubmissionTracker graphicsSubmissions;
+  // Objects replaced while rendering, destroyed once the graphics serial of
+  // their last use has completed
+  DeletionQueue deletionQueue;
+  // Queue of a family without graphics support used for uploads, or
+  // VK_NULL_HANDLE when the device has none, see TransferQueue
+  VkQueue qTransfer = VK_NULL_HANDLE;
+  SubmissionTracker transferSubmissions;
+  TransferQueue transfers;
+  // Uploads recorded during initialization, submitted together
+  TransferBatch uploads;
+  StagingRing stagingRing;
+  VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+  // In headless mode these hold the offscreen render targets instead of the
+  // swap chain images, so that the rest of the renderer does not need to know
+  // where it is drawing to.
   std::vector<VkImage> swapChainImages;
+  std::vector<Allocation> offscreenImageAllocations;
   std::vector<VkImageView> swapChainImageViews;
   std::vector<VkFramebuffer> swapChainFramebuffers;
   VkFormat swapChainImageFormat;
   VkExtent2D swapChainExtent;
-  VkRenderPass renderPass;
+  // VK_NULL_HANDLE with dynamic rendering
+  VkRenderPass renderPass = VK_NULL_HANDLE;
   VkPipelineLayout pipelineLayout;
+  // Pipeline with the viewport and the scissor baked in for
+  // staticPipelineExtent, and the same pipeline with both set dynamically,
+  // used once the swap chain no longer has that extent
   VkPipeline graphicsPipeline;
+  VkPipeline dynamicViewportPipeline;
+  VkExtent2D staticPipelineExtent;
+  // Loaded from config.pipelineCachePath at startup and saved back to it at
+  // shutdown, so that later runs do not compile the pipelines again
+  VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+  bool pipelineCacheLoaded = false;
+  // Worker threads compiling the pipelines and recording the secondary
+  // command buffers of the parallel recording mode
+  ThreadPool workers;
+  PipelineCompiler pipelineCompiler;
+  // Time spent in initVulkan() and in vkCreateGraphicsPipelines
+  double startupMilliseconds = 0.0;
+  double pipelineMilliseconds = 0.0;
   VkCommandPool commandPool;
-  std::vector<VkCommandBuffer> commandBuffers;
-  VkBuffer vertexBuffer;
-  VkDeviceMemory vertexBufferMemory;
-  VkBuffer indexBuffer;
-  VkDeviceMemory indexBufferMemory;
+  CommandBufferCache commandBuffers;
+  // Changes whenever the commands drawing the scene change, so that the
+  // command buffers recorded for the previous version are recorded again
+  uint64_t sceneVersion = 0;
+  // Records the draws on config.recordThreads workers, unused when 0
+  ParallelRecorder parallelRecorder;
+  // Vertices and indices of every mesh, and the mesh drawn by every draw
+  GeometryPool geometry;
+  Mesh quadMesh;
+  // Instance data of every frame slot in the instanced mode, rewritten by
+  // the CPU while the slot's frame is prepared and read directly by the GPU
+  std::vector<VkBuffer> instanceBuffers;
+  std::vector<Allocation> instanceBufferAllocations;
+  // Every draw of the frame as a VkDrawIndexedIndirectCommand, and their
+  // number, in the indirect mode
+  VkBuffer drawCommandBuffer = VK_NULL_HANDLE;
+  Allocation drawCommandBufferAllocation;
+  VkBuffer drawCountBuffer = VK_NULL_HANDLE;
+  Allocation drawCountBufferAllocation;
+  // GPU culling: the clip space bounds of every draw, and for every frame
+  // slot the draws that passed the culling pass and their number. The count
+  // is host visible, so that the number of visible draws can be reported.
+  VkBuffer drawBoundsBuffer = VK_NULL_HANDLE;
+  Allocation drawBoundsBufferAllocation;
+  std::vector<VkBuffer> visibleDrawBuffers;
+  std::vector<Allocation> visibleDrawBufferAllocations;
+  std::vector<VkBuffer> visibleCountBuffers;
+  std::vector<Allocation> visibleCountBufferAllocations;
+  VkDescriptorSetLayout cullSetLayout = VK_NULL_HANDLE;
+  VkDescriptorPool cullDescriptorPool = VK_NULL_HANDLE;
+  std::vector<VkDescriptorSet> cullDescriptorSets;
+  VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+  VkPipeline cullPipeline = VK_NULL_HANDLE;
   std::vector<VkSemaphore> imageAvailableSemaphores;
   std::vector<VkSemaphore> renderFinishedSemaphores;
-  std::vector<VkFence> inFlightFences;
+  // Serial of the last frame submitted in every frame slot. A slot can be
+  // reused once its serial has completed.
+  std::vector<uint64_t> frameSerials;
+  // Number of frame slots in use, changed between frames by
+  // updateFramesInFlight(). Resources exist for MAX_FRAMES_IN_FLIGHT slots.
+  uint32_t framesInFlight;
+  bool adaptiveFramesInFlight;
+  AdaptiveFrameDepth adaptiveDepth;
+  // Serials of the last MAX_FRAMES_IN_FLIGHT frames, indexed by frame number.
+  // After the depth grew, the slot of a frame may have been used by a more
+  // recent frame than the one framesInFlight frames ago, and after it
+  // shrank, the other way around: draw() waits for both.
+  std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> recentFrameSerials{};
+  uint64_t frameNumber = 0;
+  double lastWaitMilliseconds = 0.0;
+  // Start time and depth of the frame submitted in every slot whose latency
+  // has not been measured yet
+  std::vector<Benchmark::Clock::time_point> frameStartTimes;
+  std::vector<uint32_t> frameDepths;
+  std::vector<PresentProfile> frameProfiles;
+  // Present profile in use and the present mode it selected for the swap
+  // chain, see updatePresentProfile()
+  PresentProfile presentProfile;
+  VkPresentModeKHR swapChainPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+  // Number of images the swap chain is created with, 0 until the first
+  // swap chain picked the default, see updateSwapChainImageCount()
+  uint32_t swapChainImageCount;
+  AdaptiveImageCount adaptiveImages;
+  // Time the last frame waited in vkAcquireNextImageKHR and the number of
+  // earlier frames that were still queued on the GPU when it did
+  double lastAcquireMilliseconds = 0.0;
+  uint32_t lastQueuedFrames = 0;
+  std::vector<bool> latencyPending;
+  // One timestamp query pool per frame slot, holding the GPU time at the
+  // start and at the end of the render pass of the last frame submitted in
+  // that slot. The results are read once the slot's frame has completed.
+  std::vector<VkQueryPool> timestampQueryPools;
+  std::vector<bool> timestampsWritten;
+  uint64_t timestampMask = 0;
+  float timestampPeriod = 0.0f;
   uint32_t currentFrame = 0;
+  uint32_t lastImageIndex = 0;
 
   // Initialize the GLFW window.
   // GLFW is a library for creating windows and handling input.
@@ -64,23 +225,48 @@ private:
   void initWindow();
 
   // Initialize Vulkan.
+  // In headless mode there is no surface to present to, so the swap chain is
+  // replaced by a set of offscreen images that the render pass draws into.
   void initVulkan()
   {
     createInstance();
     setupDebugMessenger();
-    createSurface();
+    if (!config.headless)
+      createSurface();
     selectPhysicalDevice();
     createLogicalDevice();
-    createSwapChain();
+    allocator.init(physicalDevice, device, memoryBudgetSupported);
+    graphicsSubmissions.init(device, qGraphics, timelineSemaphoresSupported);
+    deletionQueue.init(device, allocator, graphicsSubmissions);
+    if (config.headless)
+      createOffscreenTargets();
+    else
+      createSwapChain();
     createImageViews();
-    createRenderPass();
-    createGraphicsPipeline();
-    createFramebuffers();
+    if (!dynamicRenderingSupported)
+      createRenderPass();
+    createPipelineCache();
+    createGraphicsPipelines();
+    if (gpuCullingSupported)
+      createCullPipeline();
+    if (!dynamicRenderingSupported)
+      createFramebuffers();
     createCommandPool();
-    createVertexBuffer();
-    createIndexBuffer();
+    createTransferQueue();
+    stagingRing.init(device, allocator, graphicsSubmissions,
+                     STAGING_RING_SIZE);
+    createGeometry();
+    if (indirectDrawsSupported)
+      createIndirectBuffers();
+    if (gpuCullingSupported)
+      createCullBuffers();
+    // The vertex, index and draw data are uploaded with a single submission
+    stagingRing.retire(transfers.submit(uploads));
+    if (config.instanceCount > 0)
+      createInstanceBuffers();
     createCommandBuffers();
     createSyncObjects();
+    createTimestampQueries();
   }
 
   // Create a Vulkan instance.
@@ -131,10 +317,32 @@ private:
   // the screen.
   // The presentation modes are the modes that are used to present images to
   // the screen.
+  // A swap chain that already exists is passed as oldSwapchain, so the
+  // presentation engine can hand its resources over to the new one.
   void createSwapChain();
 
+  // Replace the swap chain after the window changed, without waiting for the
+  // device: the old swap chain, its image views and its framebuffers go to
+  // the deletion queue, which destroys them once the frames submitted before
+  // the replacement have completed.
   void recreateSwapChain();
 
+  // Create the render targets used in headless mode.
+  // One color image is created for every frame in flight, backed by
+  // device-local memory. The images are used as color attachments by the
+  // render pass and as transfer sources when a screenshot is requested.
+  // The images take the place of the swap chain images, so the image views,
+  // framebuffers and recorded command buffers are the same in both modes.
+  void createOffscreenTargets();
+
+  // Copy the last rendered headless image into host memory and write it to
+  // a PPM file.
+  void saveScreenshot(const std::string &filename);
+
+  // Describe the device and the rendering mode in the benchmark report and
+  // write it to the configured output file.
+  void writeBenchmarkResults();
+
   // Create image views for the swap chain images.
   // An image view is a representation of an image that is used to access the
   // image data.
@@ -156,8 +364,12 @@ private:
   // additional functionality and validation to the render pass.
   void createRenderPass();
 
-  // Create a graphics pipeline that is used to render images to the swap
+  // Create the graphics pipelines that are used to render images to the swap
   // chain images.
+  // Two variants of the pipeline are created: one with the viewport and the
+  // scissor of the current swap chain extent baked in, and one where both are
+  // dynamic state. They are compiled concurrently by pipelineCompiler
+  // against the shared pipeline cache.
   // A graphics pipeline is a series of shaders and states that are used to
   // render images to the swap chain images.
   // The graphics pipeline is created with a set of shader stages and
@@ -185,39 +397,150 @@ private:
   // resources, such as descriptor sets and push constants.
   // The render pass is used to describe the attachments that are used to
   // render images to the swap chain images.
-  void createGraphicsPipeline(bool useDynamicState = false);
+  void createGraphicsPipelines();
+
+  // Create the compute pipeline of the culling pass, shaders/cull.comp, and
+  // the layout of its descriptor set.
+  void createCullPipeline();
+
+  // Create the pipeline cache, with the data saved by a previous run when
+  // there is a compatible pipeline cache file, and the pipeline compiler
+  // that shares it.
+  void createPipelineCache();
 
   void createFramebuffers();
   void createCommandPool();
-  void createVertexBuffer();
-
-  void createIndexBuffer();
+  // Set up the uploads on the dedicated transfer queue, or on the graphics
+  // queue when the device has no transfer-only queue family.
+  void createTransferQueue();
+  // Create the geometry pool and add the quad to it.
+  void createGeometry();
+  // Upload the draws of the frame for the indirect mode.
+  void createIndirectBuffers();
+  // Arguments of draw number draw, split evenly between the draws in the
+  // instanced mode. Draws without instances have an instanceCount of 0.
+  VkDrawIndexedIndirectCommand drawCommand(uint32_t draw) const;
+  // Upload the bounds of every draw for the culling pass, and create the
+  // buffers it writes the visible draws of every frame slot to.
+  void createCullBuffers();
+  // Clip space bounds of the instances of draw number draw, as the minimum
+  // (x, y) and the maximum (z, w).
+  glm::vec4 drawBounds(uint32_t draw) const;
+  // Record the culling pass of the frame: test the bounds of every draw
+  // against the view and write the visible ones to the slot's buffers, for
+  // the indirect draws recorded after it.
+  void recordCulling(VkCommandBuffer commandBuffer);
+  // Create one host visible instance buffer per frame slot for the
+  // instanced mode.
+  void createInstanceBuffers();
+  // Write the instances of the frame in slot frame. The slot's previous
+  // frame must have completed. The instances are split between the workers,
+  // so that millions of them can be animated every frame.
+  void updateInstances(uint32_t frame);
+  // Set up the cache of recorded command buffers, one per frame slot and
+  // swap chain image.
   void createCommandBuffers();
+  // Record the frame rendered to imageIndex. The draws are recorded inline,
+  // or into secondary command buffers by parallelRecorder when recording
+  // threads are configured. Indirect draws are always recorded inline, they
+  // take a few commands whatever their number.
   void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+  // Begin rendering to imageIndex, with the render pass and its framebuffer
+  // or with dynamic rendering. Dynamic rendering has no attachment layouts,
+  // so the image is transitioned explicitly. secondaries tells whether the
+  // draws are recorded into secondary command buffers.
+  void beginRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex,
+                      bool secondaries);
+  // End the rendering begun by beginRendering() and transition the image to
+  // the layout it is presented or copied from.
+  void endRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+  // Record draws [firstDraw, firstDraw + drawCount) of the frame with the
+  // state they need. Called concurrently by the recording threads.
+  void recordDraws(VkCommandBuffer commandBuffer, uint32_t firstDraw,
+                   uint32_t drawCount) const;
   void createSyncObjects();
+
+  // Create the timestamp query pools used to measure the GPU time of the
+  // render pass. Nothing is created when the graphics queue does not support
+  // timestamps.
+  void createTimestampQueries();
+
+  // Read the timestamps written by the last frame submitted in frame slot
+  // and report the GPU time of its render pass to the benchmark.
+  // The slot's frame must have completed, so the results are available and
+  // reading them never waits for the GPU.
+  void collectTimestamps(uint32_t frame);
   // Main loop of the application.
   // The main loop is where the application does its work.
   // In this example, the main loop does nothing, but in a real application,
   // the main loop would handle input events, update the application state,
   // and render the application.
-  // The main loop runs until the window is closed.
+  // The main loop runs until the window is closed, or until the number of
+  // frames requested with --frames has been drawn.
   // The main loop is implemented using a while loop that checks if the
   // window should close.
   // The main loop calls the glfwPollEvents function to process input events.
   // The glfwPollEvents function processes all pending events and calls the
   // appropriate callback functions.
+  // In headless mode there are no window events to process.
+  // When the benchmark is enabled, every iteration is timed as one frame.
   void mainLoop()
   {
-    while (!glfwWindowShouldClose(window))
+    for (uint32_t frame = 0;
+         config.frameCount == 0 || frame < config.frameCount; frame++)
     {
-      glfwPollEvents();
+      if (!config.headless)
+      {
+        if (glfwWindowShouldClose(window))
+          break;
+        glfwPollEvents();
+      }
+      benchmark.beginFrame();
+      auto frameStart = Benchmark::Clock::now();
       draw();
+      limitFrameRate(frameStart);
+      benchmark.endFrame();
+      updateFramesInFlight(frameStart);
+      updatePresentProfile(frameStart);
+      updateSwapChainImageCount();
     }
 
     vkDeviceWaitIdle(device); // Wait for the device to finish all operations
   }
 
+  // Draw one frame.
+  // The CPU time of every phase of the frame (waiting for the frame slot,
+  // acquiring the image, recording, submitting and presenting) is reported
+  // to the benchmark.
   void draw();
+
+  // Report the latency of the frames that completed since the last call:
+  // the time from the start of their draw() to the moment the completion
+  // was noticed, which happens at the start of a later frame. With the
+  // frame time, this shows what every depth of frames in flight trades.
+  void collectLatencies();
+
+  // Pick the depth of frames in flight for the next frame: the benchmark
+  // sweep, a depth requested with the keys 1 to 4, or the adaptive depth
+  // (key A). frameStart is the start time of the frame just drawn.
+  void updateFramesInFlight(Benchmark::Clock::time_point frameStart);
+
+  // Sleep until the frame that started at frameStart has lasted as long as
+  // the frame cap of the present profile allows.
+  void limitFrameRate(Benchmark::Clock::time_point frameStart);
+
+  // Switch the present profile for the next frame: the benchmark sweep, or
+  // the next profile when the key P was pressed. The swap chain is only
+  // recreated when the new profile selects another present mode.
+  void updatePresentProfile(Benchmark::Clock::time_point frameStart);
+
+  // Let the adaptive image count look at the acquire of the last frame, and
+  // recreate the swap chain when it picked another number of images.
+  void updateSwapChainImageCount();
+
+  // Present the rendered swap chain image and recreate the swap chain when it
+  // no longer matches the window.
+  void present(uint32_t imageIndex);
   // Clean up the application.
   // The cleanup function is called when the application is closed.
   // The cleanup function destroys the Vulkan instance and the GLFW window.
@@ -229,15 +552,40 @@ private:
   void cleanup()
   {
     cleanupSwapchain();
+    deletionQueue.flush();
 
-    vkDestroyBuffer(device, vertexBuffer, nullptr);
-    vkFreeMemory(device, vertexBufferMemory, nullptr);
-
-    vkDestroyBuffer(device, indexBuffer, nullptr);
-    vkFreeMemory(device, indexBufferMemory, nullptr);
+    geometry.destroy();
+    if (indirectDrawsSupported)
+    {
+      destroyBuffer(device, allocator, drawCommandBuffer,
+                    drawCommandBufferAllocation);
+      destroyBuffer(device, allocator, drawCountBuffer,
+                    drawCountBufferAllocation);
+    }
+    for (size_t i = 0; i < instanceBuffers.size(); i++)
+      destroyBuffer(device, allocator, instanceBuffers[i],
+                    instanceBufferAllocations[i]);
 
     vkDestroyPipeline(device, graphicsPipeline, nullptr);
+    vkDestroyPipeline(device, dynamicViewportPipeline, nullptr);
+    vkDestroyPipelineCache(device, pipelineCache, nullptr);
     vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    if (gpuCullingSupported)
+    {
+      vkDestroyPipeline(device, cullPipeline, nullptr);
+      vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+      vkDestroyDescriptorPool(device, cullDescriptorPool, nullptr);
+      vkDestroyDescriptorSetLayout(device, cullSetLayout, nullptr);
+      destroyBuffer(device, allocator, drawBoundsBuffer,
+                    drawBoundsBufferAllocation);
+      for (size_t i = 0; i < visibleDrawBuffers.size(); i++)
+      {
+        destroyBuffer(device, allocator, visibleDrawBuffers[i],
+                      visibleDrawBufferAllocations[i]);
+        destroyBuffer(device, allocator, visibleCountBuffers[i],
+                      visibleCountBufferAllocations[i]);
+      }
+    }
 
     vkDestroyRenderPass(device, renderPass, nullptr);
 
@@ -245,19 +593,33 @@ private:
     {
       vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
       vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-      vkDestroyFence(device, inFlightFences[i], nullptr);
     }
+    graphicsSubmissions.destroy();
+    transferSubmissions.destroy();
+
+    for (auto queryPool : timestampQueryPools)
+      vkDestroyQueryPool(device, queryPool, nullptr);
 
+    commandBuffers.destroy();
+    parallelRecorder.destroy();
     vkDestroyCommandPool(device, commandPool, nullptr);
+    transfers.destroy();
+    stagingRing.destroy();
+    allocator.destroy();
     vkDestroyDevice(device, nullptr);
 
     if (enableValidationLayers)
       destroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
 
-    vkDestroySurfaceKHR(instance, surface, nullptr);
+    if (!config.headless)
+      vkDestroySurfaceKHR(instance, surface, nullptr);
     vkDestroyInstance(instance, nullptr);
-    glfwDestroyWindow(window);
-    glfwTerminate();
+
+    if (!config.headless)
+    {
+      glfwDestroyWindow(window);
+      glfwTerminate();
+    }
   }
 
   void cleanupSwapchain()
@@ -266,6 +628,17 @@ private:
       vkDestroyFramebuffer(device, framebuffer, nullptr);
     for (auto imageView : swapChainImageViews)
       vkDestroyImageView(device, imageView, nullptr);
+
+    if (config.headless)
+    {
+      for (size_t i = 0; i < swapChainImages.size(); i++)
+      {
+        vkDestroyImage(device, swapChainImages[i], nullptr);
+        allocator.free(offscreenImageAllocations[i]);
+      }
+      return;
+    }
+
     vkDestroySwapchainKHR(device, swapChain, nullptr);
   }
 };
@@ -277,3 +650,22 @@ static void framebufferResizeCallback(GLFWwindow *window, int width,
       glfwGetWindowUserPointer(window));
   app->framebufferResized = true;
 }
+
+// Keys 1 to 4 select the number of frames in flight, A the adaptive depth and
+// P cycles through the present profiles
+static void keyCallback(GLFWwindow *window, int key, int /*scancode*/,
+                        int action, int /*mods*/)
+{
+  if (action != GLFW_PRESS)
+    return;
+
+  auto app = reinterpret_cast<HelloTriangleApplication *>(
+      glfwGetWindowUserPointer(window));
+  if (key >= GLFW_KEY_1 &&
+      key < GLFW_KEY_1 + static_cast<int>(MAX_FRAMES_IN_FLIGHT))
+    app->requestedFramesInFlight = key - GLFW_KEY_1 + 1;
+  else if (key == GLFW_KEY_A)
+    app->adaptiveRequested = true;
+  else if (key == GLFW_KEY_P)
+    app->presentProfileRequested = true;
+}
@@ -19,10 +19,10 @@ uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter,
   throw std::runtime_error("failed to find suitable memory type!");
 }
 
-void createBuffer(VkDevice logicalDevice, VkPhysicalDevice physicalDevice,
+void createBuffer(VkDevice logicalDevice, MemoryAllocator &allocator,
                   VkDeviceSize size, VkBufferUsageFlags usage,
-                  VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                  VkDeviceMemory &bufferMemory)
+                  MemoryUsage memoryUsage, VkBuffer &buffer,
+                  Allocation &allocation)
 {
   VkBufferCreateInfo bufferInfo{.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
                                 .pNext = nullptr,
@@ -37,25 +37,22 @@ void createBuffer(VkDevice logicalDevice, VkPhysicalDevice physicalDevice,
   VkMemoryRequirements memRequirements;
   vkGetBufferMemoryRequirements(logicalDevice, buffer, &memRequirements);
 
-  VkMemoryAllocateInfo allocateInfo{
-      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-      .pNext = nullptr,
-      .allocationSize = memRequirements.size,
-      .memoryTypeIndex =
-          findMemoryType(physicalDevice, memRequirements.memoryTypeBits,
-                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT),
-  };
+  allocation =
+      allocator.allocate(memRequirements, memoryUsage, ResourceKind::Linear);
 
-  if (vkAllocateMemory(logicalDevice, &allocateInfo, nullptr, &bufferMemory) !=
-      VK_SUCCESS)
-    throw std::runtime_error("failed to allocate vertex buffer memory!");
+  vkBindBufferMemory(logicalDevice, buffer, allocation.memory,
+                     allocation.offset);
+}
 
-  vkBindBufferMemory(logicalDevice, buffer, bufferMemory, 0);
+void destroyBuffer(VkDevice logicalDevice, MemoryAllocator &allocator,
+                   VkBuffer buffer, Allocation &allocation)
+{
+  vkDestroyBuffer(logicalDevice, buffer, nullptr);
+  allocator.free(allocation);
 }
 
-void copyBuffer(VkDevice device, VkCommandPool commandPool, VkQueue graphicsQueue, VkBuffer srcBuffer,
-                VkBuffer dstBuffer, VkDeviceSize size)
+VkCommandBuffer beginSingleTimeCommands(VkDevice device,
+                                        VkCommandPool commandPool)
 {
   VkCommandBufferAllocateInfo allocInfo{
       .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
@@ -80,14 +77,13 @@ void copyBuffer(VkDevice device, VkCommandPool commandPool, VkQueue graphicsQueu
   if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
     throw std::runtime_error("failed to begin recording command buffer!");
 
-  VkBufferCopy copyRegion{
-      .srcOffset = 0,
-      .dstOffset = 0,
-      .size = size,
-  };
-
-  vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+  return commandBuffer;
+}
 
+uint64_t endSingleTimeCommands(VkDevice device, VkCommandPool commandPool,
+                               SubmissionTracker &submissions,
+                               VkCommandBuffer commandBuffer)
+{
   if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
     throw std::runtime_error("failed to record command buffer!");
 
@@ -101,10 +97,57 @@ void copyBuffer(VkDevice device, VkCommandPool commandPool, VkQueue graphicsQueu
                           .signalSemaphoreCount = 0,
                           .pSignalSemaphores = nullptr};
 
-  if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) !=
-      VK_SUCCESS)
-    throw std::runtime_error("failed to submit copy command buffer!");
-
-  vkQueueWaitIdle(graphicsQueue);
+  // Only this submission is waited for, not the frames still in flight on
+  // the same queue
+  uint64_t serial = submissions.submit(1, &submitInfo);
+  submissions.wait(serial);
   vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+  return serial;
+}
+
+void copyImageToBuffer(VkDevice device, VkCommandPool commandPool,
+                       SubmissionTracker &submissions, VkImage image,
+                       VkExtent2D extent, VkBuffer dstBuffer)
+{
+  VkCommandBuffer commandBuffer =
+      beginSingleTimeCommands(device, commandPool);
+
+  VkBufferImageCopy region{
+      .bufferOffset = 0,
+      .bufferRowLength = 0, // 0 means tightly packed
+      .bufferImageHeight = 0,
+      .imageSubresource =
+          {
+              .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+              .mipLevel = 0,
+              .baseArrayLayer = 0,
+              .layerCount = 1,
+          },
+      .imageOffset = {0, 0, 0},
+      .imageExtent = {extent.width, extent.height, 1},
+  };
+
+  vkCmdCopyImageToBuffer(commandBuffer, image,
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dstBuffer, 1,
+                         &region);
+
+  // Waiting for the submission to complete does not make the transfer writes
+  // visible to the host, the barrier does.
+  VkBufferMemoryBarrier barrier{
+      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+      .pNext = nullptr,
+      .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .buffer = dstBuffer,
+      .offset = 0,
+      .size = VK_WHOLE_SIZE,
+  };
+
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier,
+                       0, nullptr);
+
+  endSingleTimeCommands(device, commandPool, submissions, commandBuffer);
 }
\ No newline at end of file
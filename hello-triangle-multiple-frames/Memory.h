@@ -1,12 +1,39 @@
+#pragma once
 #define GLFW_INCLUDE_VULKAN
+#include "MemoryAllocator.h"
+#include "SubmissionTracker.h"
 #include <GLFW/glfw3.h>
 uint32_t findMemoryType(VkPhysicalDevice device, uint32_t typeFilter,
                         VkMemoryPropertyFlags properties);
 
-void createBuffer(VkDevice logicalDevice, VkPhysicalDevice device,
+// Create a buffer and bind it to memory sub-allocated from allocator.
+// The memory type is picked by the placement policy of memoryUsage, see
+// MemoryUsage. Host visible memory is persistently mapped, use
+// allocation.mapped to access it, and allocator.flush()/invalidate() around
+// the accesses in case the memory is not host coherent.
+void createBuffer(VkDevice logicalDevice, MemoryAllocator &allocator,
                   VkDeviceSize size, VkBufferUsageFlags usage,
-                  VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                  VkDeviceMemory &bufferMemory);
+                  MemoryUsage memoryUsage, VkBuffer &buffer,
+                  Allocation &allocation);
 
-void copyBuffer(VkDevice device, VkCommandPool commandPool, VkQueue graphicsQueue,
-                VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
\ No newline at end of file
+void destroyBuffer(VkDevice logicalDevice, MemoryAllocator &allocator,
+                   VkBuffer buffer, Allocation &allocation);
+
+// Allocate a primary command buffer from commandPool and begin recording it
+// for a single submission.
+VkCommandBuffer beginSingleTimeCommands(VkDevice device,
+                                        VkCommandPool commandPool);
+
+// End recording of a command buffer returned by beginSingleTimeCommands(),
+// submit it to the queue of submissions, wait for it to complete and free it.
+// Returns the serial of the submission.
+uint64_t endSingleTimeCommands(VkDevice device, VkCommandPool commandPool,
+                               SubmissionTracker &submissions,
+                               VkCommandBuffer commandBuffer);
+
+// Copy the color contents of image, which must be in
+// VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, into dstBuffer as tightly packed rows
+// and make the copied data visible to the host.
+void copyImageToBuffer(VkDevice device, VkCommandPool commandPool,
+                       SubmissionTracker &submissions, VkImage image,
+                       VkExtent2D extent, VkBuffer dstBuffer);
\ No newline at end of file
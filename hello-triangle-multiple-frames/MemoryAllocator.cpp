@@ -0,0 +1,425 @@
+#include "MemoryAllocator.h"
+#include <algorithm>
+#include <stdexcept>
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Property flags a memory type must have, and flags it should rather not
+// have, for one rank of a placement policy
+struct PlacementRank
+{
+  VkMemoryPropertyFlags required;
+  VkMemoryPropertyFlags avoided;
+};
+
+static const std::vector<PlacementRank> &placementRanks(MemoryUsage usage)
+{
+  static const std::vector<PlacementRank> gpuOnly = {
+      // Keep the host visible part of VRAM for Dynamic resources
+      {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT},
+      {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0},
+      {0, 0},
+  };
+  static const std::vector<PlacementRank> upload = {
+      {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT},
+      {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+       0},
+      {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, 0},
+  };
+  static const std::vector<PlacementRank> readback = {
+      {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT |
+           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+       0},
+      {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+       0},
+      {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+       0},
+      {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, 0},
+  };
+  static const std::vector<PlacementRank> dynamic = {
+      {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+       0},
+      {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+       0},
+      {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, 0},
+  };
+
+  switch (usage)
+  {
+  case MemoryUsage::GpuOnly:
+    return gpuOnly;
+  case MemoryUsage::Upload:
+    return upload;
+  case MemoryUsage::Readback:
+    return readback;
+  case MemoryUsage::Dynamic:
+  default:
+    return dynamic;
+  }
+}
+
+void MemoryAllocator::init(VkPhysicalDevice physicalDevice, VkDevice device,
+                           bool memoryBudget)
+{
+  this->physicalDevice = physicalDevice;
+  this->device = device;
+  this->memoryBudget = memoryBudget;
+  budgetStale = true;
+  heapReserved.fill(0);
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+  pools.assign(memProperties.memoryTypeCount * 2, Pool{});
+  for (uint32_t type = 0; type < memProperties.memoryTypeCount; type++)
+  {
+    VkDeviceSize heapSize =
+        memProperties.memoryHeaps[memProperties.memoryTypes[type].heapIndex]
+            .size;
+
+    // Small heaps (e.g. the 256 MiB host visible VRAM window) would be used
+    // up by a few blocks, so their blocks are made smaller
+    VkDeviceSize blockSize = MEMORY_BLOCK_SIZE;
+    while (blockSize > 2 * MIN_ALLOCATION_SIZE && blockSize * 8 > heapSize)
+      blockSize /= 2;
+
+    pool(type, ResourceKind::Linear).blockSize = blockSize;
+    pool(type, ResourceKind::Optimal).blockSize = blockSize;
+  }
+}
+
+void MemoryAllocator::destroy()
+{
+  for (auto &pool : pools)
+    for (auto &block : pool.blocks)
+      vkFreeMemory(device, block.memory, nullptr);
+
+  pools.clear();
+  statistics = MemoryStats{};
+}
+
+Allocation MemoryAllocator::allocate(const VkMemoryRequirements &requirements,
+                                     uint32_t memoryType, ResourceKind kind)
+{
+  Pool &pool = this->pool(memoryType, kind);
+  Allocation allocation{
+      .size = requirements.size,
+      .memoryType = memoryType,
+      .kind = kind,
+  };
+
+  uint32_t sizeClass = this->sizeClass(pool, requirements);
+  if (sizeClass == DEDICATED_ALLOCATION)
+  {
+    allocation.memory = allocateDeviceMemory(requirements.size, memoryType,
+                                             &allocation.mapped);
+    statistics.dedicatedCount++;
+    statistics.reservedBytes += requirements.size;
+    statistics.allocatedBytes += requirements.size;
+  }
+  else
+  {
+    VkDeviceSize chunkSize = MIN_ALLOCATION_SIZE << sizeClass;
+    auto &freeList = pool.freeLists[sizeClass];
+    Chunk chunk;
+
+    if (!freeList.empty())
+    {
+      chunk = freeList.back();
+      freeList.pop_back();
+    }
+    else
+    {
+      if (pool.blocks.empty() ||
+          alignUp(pool.blocks.back().used, chunkSize) + chunkSize >
+              pool.blockSize)
+      {
+        if (!pool.blocks.empty())
+        {
+          Block &full = pool.blocks.back();
+          carve(pool, static_cast<uint32_t>(pool.blocks.size() - 1),
+                full.used, pool.blockSize);
+          full.used = pool.blockSize;
+        }
+
+        Block block{.used = 0};
+        block.memory =
+            allocateDeviceMemory(pool.blockSize, memoryType, &block.mapped);
+        pool.blocks.push_back(block);
+        statistics.blockCount++;
+        statistics.reservedBytes += pool.blockSize;
+      }
+
+      chunk.block = static_cast<uint32_t>(pool.blocks.size() - 1);
+      Block &block = pool.blocks.back();
+      chunk.offset = alignUp(block.used, chunkSize);
+      carve(pool, chunk.block, block.used, chunk.offset);
+      block.used = chunk.offset + chunkSize;
+    }
+
+    const Block &block = pool.blocks[chunk.block];
+    allocation.memory = block.memory;
+    allocation.offset = chunk.offset;
+    allocation.mapped =
+        block.mapped ? static_cast<char *>(block.mapped) + chunk.offset
+                     : nullptr;
+    allocation.block = chunk.block;
+    allocation.sizeClass = sizeClass;
+    statistics.allocatedBytes += chunkSize;
+  }
+
+  statistics.allocationCount++;
+  statistics.requestedBytes += requirements.size;
+  return allocation;
+}
+
+Allocation MemoryAllocator::allocate(const VkMemoryRequirements &requirements,
+                                     MemoryUsage usage, ResourceKind kind)
+{
+  return allocate(requirements, findMemoryType(requirements, usage, kind),
+                  kind);
+}
+
+uint32_t MemoryAllocator::findMemoryType(
+    const VkMemoryRequirements &requirements, MemoryUsage usage,
+    ResourceKind kind)
+{
+  for (bool respectBudget : {true, false})
+    for (const PlacementRank &rank : placementRanks(usage))
+      for (uint32_t type = 0; type < memProperties.memoryTypeCount; type++)
+      {
+        VkMemoryPropertyFlags flags =
+            memProperties.memoryTypes[type].propertyFlags;
+
+        if (!(requirements.memoryTypeBits & (1u << type)) ||
+            (flags & rank.required) != rank.required ||
+            (flags & rank.avoided) != 0)
+          continue;
+
+        if (respectBudget &&
+            !fitsBudget(type, bytesToReserve(pool(type, kind), requirements)))
+          continue;
+
+        return type;
+      }
+
+  throw std::runtime_error("failed to find suitable memory type!");
+}
+
+void MemoryAllocator::flush(const Allocation &allocation)
+{
+  VkMappedMemoryRange range;
+  mappedRange(allocation, range);
+  if (range.memory != VK_NULL_HANDLE &&
+      vkFlushMappedMemoryRanges(device, 1, &range) != VK_SUCCESS)
+    throw std::runtime_error("failed to flush mapped memory!");
+}
+
+void MemoryAllocator::invalidate(const Allocation &allocation)
+{
+  VkMappedMemoryRange range;
+  mappedRange(allocation, range);
+  if (range.memory != VK_NULL_HANDLE &&
+      vkInvalidateMappedMemoryRanges(device, 1, &range) != VK_SUCCESS)
+    throw std::runtime_error("failed to invalidate mapped memory!");
+}
+
+void MemoryAllocator::free(Allocation &allocation)
+{
+  if (allocation.memory == VK_NULL_HANDLE)
+    return;
+
+  if (allocation.sizeClass == DEDICATED_ALLOCATION)
+  {
+    vkFreeMemory(device, allocation.memory, nullptr);
+    heapReserved[memProperties.memoryTypes[allocation.memoryType].heapIndex] -=
+        allocation.size;
+    budgetStale = true;
+    statistics.dedicatedCount--;
+    statistics.reservedBytes -= allocation.size;
+    statistics.allocatedBytes -= allocation.size;
+  }
+  else
+  {
+    pool(allocation.memoryType, allocation.kind)
+        .freeLists[allocation.sizeClass]
+        .push_back({allocation.block, allocation.offset});
+    statistics.allocatedBytes -= MIN_ALLOCATION_SIZE << allocation.sizeClass;
+  }
+
+  statistics.allocationCount--;
+  statistics.requestedBytes -= allocation.size;
+  allocation = Allocation{};
+}
+
+MemoryAllocator::Pool &MemoryAllocator::pool(uint32_t memoryType,
+                                             ResourceKind kind)
+{
+  return pools[memoryType * 2 + (kind == ResourceKind::Optimal ? 1 : 0)];
+}
+
+uint32_t MemoryAllocator::sizeClass(
+    const Pool &pool, const VkMemoryRequirements &requirements) const
+{
+  // Chunks are aligned to their size, so rounding the size up to the
+  // alignment also takes care of the alignment
+  VkDeviceSize needed = std::max(requirements.size, requirements.alignment);
+  VkDeviceSize chunkSize = MIN_ALLOCATION_SIZE;
+  uint32_t sizeClass = 0;
+  while (chunkSize < needed && sizeClass < SIZE_CLASS_COUNT)
+  {
+    chunkSize *= 2;
+    sizeClass++;
+  }
+
+  if (sizeClass == SIZE_CLASS_COUNT || chunkSize > pool.blockSize / 2)
+    return DEDICATED_ALLOCATION;
+
+  return sizeClass;
+}
+
+VkDeviceSize MemoryAllocator::bytesToReserve(
+    const Pool &pool, const VkMemoryRequirements &requirements) const
+{
+  uint32_t sizeClass = this->sizeClass(pool, requirements);
+  if (sizeClass == DEDICATED_ALLOCATION)
+    return requirements.size;
+
+  VkDeviceSize chunkSize = MIN_ALLOCATION_SIZE << sizeClass;
+  if (!pool.freeLists[sizeClass].empty() ||
+      (!pool.blocks.empty() &&
+       alignUp(pool.blocks.back().used, chunkSize) + chunkSize <=
+           pool.blockSize))
+    return 0;
+
+  return pool.blockSize;
+}
+
+bool MemoryAllocator::fitsBudget(uint32_t memoryType, VkDeviceSize size)
+{
+  if (size == 0)
+    return true;
+
+  if (budgetStale)
+    updateBudget();
+
+  uint32_t heap = memProperties.memoryTypes[memoryType].heapIndex;
+  return heapUsage[heap] + size <= heapBudget[heap];
+}
+
+void MemoryAllocator::updateBudget()
+{
+  if (memoryBudget)
+  {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+        .pNext = nullptr,
+    };
+    VkPhysicalDeviceMemoryProperties2 properties{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+        .pNext = &budgetProperties,
+    };
+    vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
+
+    for (uint32_t heap = 0; heap < memProperties.memoryHeapCount; heap++)
+    {
+      heapBudget[heap] = budgetProperties.heapBudget[heap];
+      heapUsage[heap] = budgetProperties.heapUsage[heap];
+    }
+  }
+  else
+  {
+    for (uint32_t heap = 0; heap < memProperties.memoryHeapCount; heap++)
+    {
+      heapBudget[heap] = memProperties.memoryHeaps[heap].size / 10 * 8;
+      heapUsage[heap] = heapReserved[heap];
+    }
+  }
+
+  budgetStale = false;
+}
+
+void MemoryAllocator::mappedRange(const Allocation &allocation,
+                                  VkMappedMemoryRange &range)
+{
+  range = VkMappedMemoryRange{
+      .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+      .pNext = nullptr,
+      .memory = VK_NULL_HANDLE,
+      .offset = 0,
+      .size = VK_WHOLE_SIZE,
+  };
+
+  if (!allocation.mapped || (memProperties.memoryTypes[allocation.memoryType]
+                                 .propertyFlags &
+                             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+    return;
+
+  // Ranges must be multiples of nonCoherentAtomSize, which is at most 256
+  // bytes. Chunks are aligned to their size of at least MIN_ALLOCATION_SIZE,
+  // so flushing the whole chunk always is.
+  range.memory = allocation.memory;
+  if (allocation.sizeClass != DEDICATED_ALLOCATION)
+  {
+    range.offset = allocation.offset;
+    range.size = MIN_ALLOCATION_SIZE << allocation.sizeClass;
+  }
+}
+
+VkDeviceMemory MemoryAllocator::allocateDeviceMemory(VkDeviceSize size,
+                                                     uint32_t memoryType,
+                                                     void **mapped)
+{
+  VkMemoryAllocateInfo allocateInfo{
+      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+      .pNext = nullptr,
+      .allocationSize = size,
+      .memoryTypeIndex = memoryType,
+  };
+
+  VkDeviceMemory memory;
+  if (vkAllocateMemory(device, &allocateInfo, nullptr, &memory) != VK_SUCCESS)
+    throw std::runtime_error("failed to allocate device memory block!");
+  statistics.driverAllocationCount++;
+  heapReserved[memProperties.memoryTypes[memoryType].heapIndex] += size;
+  budgetStale = true;
+
+  *mapped = nullptr;
+  if ((memProperties.memoryTypes[memoryType].propertyFlags &
+       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+      vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS)
+    throw std::runtime_error("failed to map device memory block!");
+
+  return memory;
+}
+
+void MemoryAllocator::carve(Pool &pool, uint32_t block, VkDeviceSize begin,
+                            VkDeviceSize end)
+{
+  VkDeviceSize largestChunk =
+      std::min(MIN_ALLOCATION_SIZE << (SIZE_CLASS_COUNT - 1),
+               pool.blockSize / 2);
+
+  while (end - begin >= MIN_ALLOCATION_SIZE)
+  {
+    // The largest chunk that is aligned at begin and ends before end
+    VkDeviceSize chunkSize =
+        begin == 0 ? largestChunk : std::min(begin & (~begin + 1), largestChunk);
+    while (chunkSize > end - begin)
+      chunkSize /= 2;
+
+    uint32_t sizeClass = 0;
+    while ((MIN_ALLOCATION_SIZE << sizeClass) < chunkSize)
+      sizeClass++;
+
+    pool.freeLists[sizeClass].push_back({block, begin});
+    begin += chunkSize;
+  }
+}
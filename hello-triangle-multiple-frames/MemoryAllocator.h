@@ -0,0 +1,198 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Size of the VkDeviceMemory blocks resources are carved from.
+// Heaps smaller than 8 blocks use blocks of 1/8 of the heap instead.
+inline const VkDeviceSize MEMORY_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+// Smallest size class. Every allocation is rounded up to a power of two that
+// is at least this large.
+inline const VkDeviceSize MIN_ALLOCATION_SIZE = 256;
+
+// Number of size classes: 256 B, 512 B, ..., MEMORY_BLOCK_SIZE / 2.
+// Larger requests get a dedicated VkDeviceMemory.
+inline const uint32_t SIZE_CLASS_COUNT = 18;
+
+inline const uint32_t DEDICATED_ALLOCATION = UINT32_MAX;
+
+// Kind of resource bound to an allocation.
+// bufferImageGranularity requires linear resources (buffers, linear images)
+// and optimal images to be kept apart in memory, so they never share a block.
+enum class ResourceKind
+{
+  Linear,
+  Optimal,
+};
+
+// Intended use of the memory of a resource. The allocator turns it into a
+// memory type with MemoryAllocator::findMemoryType().
+enum class MemoryUsage
+{
+  // Only accessed by the GPU: render targets, and vertex and index buffers
+  // filled by a transfer. Placed in DEVICE_LOCAL memory.
+  GpuOnly,
+  // Written once by the CPU and read once by the GPU: staging buffers.
+  // Placed in host memory, leaving the small host visible part of VRAM to
+  // Dynamic resources.
+  Upload,
+  // Written by the GPU and read by the CPU: screenshots, query results.
+  // Placed in HOST_CACHED memory, reading uncached memory is very slow.
+  Readback,
+  // Rewritten by the CPU every frame and read directly by the GPU:
+  // per-frame uniforms, streamed vertices. Placed in DEVICE_LOCAL and
+  // HOST_VISIBLE memory (resizable BAR or UMA) when there is some.
+  Dynamic,
+};
+
+// A range of device memory handed out by the MemoryAllocator.
+// Bind resources with vkBind*Memory(device, resource, memory, offset).
+struct Allocation
+{
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  // Host pointer to offset, if the memory type is host visible.
+  // Blocks stay mapped for their whole life, so the memory of an allocation
+  // must never be mapped with vkMapMemory.
+  void *mapped = nullptr;
+  uint32_t memoryType = 0;
+  ResourceKind kind = ResourceKind::Linear;
+  uint32_t block = 0;
+  uint32_t sizeClass = DEDICATED_ALLOCATION;
+};
+
+// Allocation statistics, see MemoryAllocator::stats().
+struct MemoryStats
+{
+  // Blocks resources are carved from
+  uint32_t blockCount = 0;
+  // Allocations too large for a block, with their own VkDeviceMemory
+  uint32_t dedicatedCount = 0;
+  // Live allocations
+  uint32_t allocationCount = 0;
+  // Calls to vkAllocateMemory since the allocator was created
+  uint64_t driverAllocationCount = 0;
+  // Device memory allocated from the driver
+  VkDeviceSize reservedBytes = 0;
+  // Memory handed out, rounded up to the size classes
+  VkDeviceSize allocatedBytes = 0;
+  // Memory requested by the live allocations
+  VkDeviceSize requestedBytes = 0;
+};
+
+// Block based device memory sub-allocator.
+// Drivers limit the number of live VkDeviceMemory objects
+// (maxMemoryAllocationCount, as low as 4096) and every vkAllocateMemory call
+// is expensive, so resources are instead placed in large blocks.
+// There is one pool per memory type and resource kind. A pool keeps a free
+// list per power-of-two size class, so allocating and freeing are O(1):
+// - a request is served from the free list of its size class,
+// - or by bumping the offset of the newest block of the pool,
+// - and only when that block is full, a new block is allocated.
+// Chunks are aligned to their size class, which is at least as large as the
+// alignment the resource requires.
+// Freed chunks go back to the free list of their class and memory is only
+// returned to the driver when the allocator is destroyed.
+//
+// Memory types are picked by intended usage. Every MemoryUsage has a ranked
+// list of property flags, and the first memory type that matches a rank and
+// whose heap has room for the request wins. The room left in a heap comes
+// from VK_EXT_memory_budget when the device supports it, which also accounts
+// for memory used by other applications. Otherwise the allocator only knows
+// its own usage and keeps it below 80% of the heap size.
+class MemoryAllocator
+{
+public:
+  // memoryBudget tells whether VK_EXT_memory_budget is enabled on device.
+  // It requires vkGetPhysicalDeviceMemoryProperties2 (Vulkan 1.1).
+  void init(VkPhysicalDevice physicalDevice, VkDevice device,
+            bool memoryBudget);
+  void destroy();
+
+  // Allocate memory of type memoryType that satisfies the size and alignment
+  // of requirements.
+  Allocation allocate(const VkMemoryRequirements &requirements,
+                      uint32_t memoryType, ResourceKind kind);
+  // Allocate memory of the best type for usage, see findMemoryType().
+  Allocation allocate(const VkMemoryRequirements &requirements,
+                      MemoryUsage usage, ResourceKind kind);
+  void free(Allocation &allocation);
+
+  // Pick the memory type for a resource with requirements used as usage.
+  // Ranks are tried in order, skipping heaps that are out of budget. If every
+  // heap is out of budget the budget is ignored: exceeding it degrades
+  // performance, failing the allocation would end the application.
+  uint32_t findMemoryType(const VkMemoryRequirements &requirements,
+                          MemoryUsage usage, ResourceKind kind);
+
+  // Make host writes to a mapped allocation visible to the device, and
+  // device writes visible to the host. Only needed when the memory type is
+  // not HOST_COHERENT, otherwise they do nothing.
+  void flush(const Allocation &allocation);
+  void invalidate(const Allocation &allocation);
+
+  MemoryStats stats() const { return statistics; }
+
+  const VkPhysicalDeviceMemoryProperties &memoryProperties() const
+  {
+    return memProperties;
+  }
+
+private:
+  struct Block
+  {
+    VkDeviceMemory memory;
+    void *mapped;
+    // Offset up to which the block has been carved into chunks
+    VkDeviceSize used;
+  };
+
+  struct Chunk
+  {
+    uint32_t block;
+    VkDeviceSize offset;
+  };
+
+  struct Pool
+  {
+    VkDeviceSize blockSize = 0;
+    std::vector<Block> blocks;
+    std::array<std::vector<Chunk>, SIZE_CLASS_COUNT> freeLists;
+  };
+
+  VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+  VkDevice device = VK_NULL_HANDLE;
+  VkPhysicalDeviceMemoryProperties memProperties{};
+  // Indexed by memory type * 2 + resource kind
+  std::vector<Pool> pools;
+  MemoryStats statistics;
+
+  bool memoryBudget = false;
+  // The budget is queried again only after device memory was allocated or
+  // freed, so allocations served from existing blocks never call the driver
+  bool budgetStale = true;
+  std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> heapBudget{};
+  std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> heapUsage{};
+  // Device memory allocated by this allocator, per heap
+  std::array<VkDeviceSize, VK_MAX_MEMORY_HEAPS> heapReserved{};
+
+  Pool &pool(uint32_t memoryType, ResourceKind kind);
+  // Size class of requirements in pool, or DEDICATED_ALLOCATION
+  uint32_t sizeClass(const Pool &pool,
+                     const VkMemoryRequirements &requirements) const;
+  // Device memory that must be allocated from the driver to serve
+  // requirements from pool, 0 if it fits in the blocks of the pool
+  VkDeviceSize bytesToReserve(const Pool &pool,
+                              const VkMemoryRequirements &requirements) const;
+  bool fitsBudget(uint32_t memoryType, VkDeviceSize size);
+  void updateBudget();
+  void mappedRange(const Allocation &allocation, VkMappedMemoryRange &range);
+  VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType,
+                                      void **mapped);
+  // Put the unused memory between begin and end on the free lists
+  void carve(Pool &pool, uint32_t block, VkDeviceSize begin, VkDeviceSize end);
+};
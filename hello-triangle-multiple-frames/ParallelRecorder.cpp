@@ -0,0 +1,141 @@
+#include "ParallelRecorder.h"
+#include <algorithm>
+#include <future>
+#include <stdexcept>
+
+void ParallelRecorder::init(VkDevice device, uint32_t queueFamily,
+                            ThreadPool &workers, uint32_t frameCount,
+                            uint32_t imageCount, uint32_t threadCount)
+{
+  this->device = device;
+  this->workers = &workers;
+  this->frameCount = frameCount;
+  this->imageCount = imageCount;
+  threads = threadCount;
+
+  // Secondary command buffers are recorded again with vkBeginCommandBuffer,
+  // which resets them implicitly
+  VkCommandPoolCreateInfo poolInfo{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+      .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+      .queueFamilyIndex = queueFamily,
+  };
+
+  commandPools.resize(frameCount * threads);
+  for (auto &commandPool : commandPools)
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) !=
+        VK_SUCCESS)
+      throw std::runtime_error("failed to create command pool!");
+
+  secondaries.assign(frameCount * imageCount * threads, VK_NULL_HANDLE);
+  spare.assign(commandPools.size(), {});
+}
+
+void ParallelRecorder::destroy()
+{
+  // Destroying a pool frees its command buffers
+  for (auto commandPool : commandPools)
+    vkDestroyCommandPool(device, commandPool, nullptr);
+  commandPools.clear();
+  secondaries.clear();
+  spare.clear();
+}
+
+void ParallelRecorder::record(VkCommandBuffer primary, uint32_t frame,
+                              uint32_t image,
+                              const VkCommandBufferInheritanceInfo &inheritance,
+                              uint32_t drawCount, const RecordDraws &recordDraws)
+{
+  uint32_t used = std::max(1u, std::min(threads, drawCount));
+  std::vector<VkCommandBuffer> commandBuffers(used);
+  std::vector<std::future<void>> recordings;
+
+  for (uint32_t thread = 0; thread < used; thread++)
+  {
+    // Allocating from the pool happens here, on the calling thread, so the
+    // workers only ever record
+    VkCommandBuffer commandBuffer = secondary(frame, image, thread);
+    commandBuffers[thread] = commandBuffer;
+
+    uint32_t firstDraw = drawCount * thread / used;
+    uint32_t lastDraw = drawCount * (thread + 1) / used;
+    recordings.push_back(workers->submit(
+        [commandBuffer, &inheritance, firstDraw, lastDraw, &recordDraws]
+        {
+          VkCommandBufferBeginInfo beginInfo{
+              .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+              .pNext = nullptr,
+              .flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+              .pInheritanceInfo = &inheritance,
+          };
+
+          if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+            throw std::runtime_error(
+                "failed to begin recording command buffer!");
+
+          recordDraws(commandBuffer, firstDraw, lastDraw - firstDraw);
+
+          if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+            throw std::runtime_error("failed to record command buffer!");
+        }));
+  }
+
+  // The tasks refer to inheritance and recordDraws, so all of them must be
+  // done before an error is rethrown
+  for (auto &recording : recordings)
+    recording.wait();
+  for (auto &recording : recordings)
+    recording.get();
+
+  vkCmdExecuteCommands(primary, used, commandBuffers.data());
+}
+
+void ParallelRecorder::invalidate(uint32_t imageCount)
+{
+  if (imageCount == this->imageCount)
+    return;
+
+  for (uint32_t frame = 0; frame < frameCount; frame++)
+    for (uint32_t image = 0; image < this->imageCount; image++)
+      for (uint32_t thread = 0; thread < threads; thread++)
+      {
+        VkCommandBuffer commandBuffer =
+            secondaries[(frame * this->imageCount + image) * threads + thread];
+        if (commandBuffer != VK_NULL_HANDLE)
+          spare[frame * threads + thread].push_back(commandBuffer);
+      }
+
+  this->imageCount = imageCount;
+  secondaries.assign(frameCount * imageCount * threads, VK_NULL_HANDLE);
+}
+
+VkCommandBuffer ParallelRecorder::secondary(uint32_t frame, uint32_t image,
+                                            uint32_t thread)
+{
+  VkCommandBuffer &commandBuffer =
+      secondaries[(frame * imageCount + image) * threads + thread];
+  if (commandBuffer != VK_NULL_HANDLE)
+    return commandBuffer;
+
+  std::vector<VkCommandBuffer> &leftOver = spare[frame * threads + thread];
+  if (!leftOver.empty())
+  {
+    commandBuffer = leftOver.back();
+    leftOver.pop_back();
+    return commandBuffer;
+  }
+
+  VkCommandBufferAllocateInfo allocInfo{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .pNext = nullptr,
+      .commandPool = commandPools[frame * threads + thread],
+      .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+      .commandBufferCount = 1,
+  };
+
+  if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) !=
+      VK_SUCCESS)
+    throw std::runtime_error("failed to allocate command buffers!");
+
+  return commandBuffer;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include "ThreadPool.h"
+#include <GLFW/glfw3.h>
+#include <functional>
+#include <vector>
+
+// Records the draws of a render pass on several threads.
+// The draws are split into one contiguous range per thread and every range
+// is recorded into a secondary command buffer on a worker of a thread pool.
+// The primary command buffer then executes the secondary ones in order.
+// Command pools are externally synchronized, so every (frame slot, thread)
+// pair owns its own pool and no two workers ever record from the same one.
+// Like the primary command buffers of CommandBufferCache, the secondary ones
+// are kept per frame slot and swap chain image: re-recording the commands of
+// one image does not touch those executed by the primary of another image.
+class ParallelRecorder
+{
+public:
+  // Records the draws [firstDraw, firstDraw + drawCount) into commandBuffer,
+  // including the state they need (pipeline, vertex buffers, ...): secondary
+  // command buffers do not inherit it from the primary one.
+  // Called concurrently from several threads.
+  using RecordDraws = std::function<void(VkCommandBuffer commandBuffer,
+                                         uint32_t firstDraw,
+                                         uint32_t drawCount)>;
+
+  void init(VkDevice device, uint32_t queueFamily, ThreadPool &workers,
+            uint32_t frameCount, uint32_t imageCount, uint32_t threadCount);
+  void destroy();
+
+  // Record drawCount draws for frame slot and image and execute them in
+  // primary, which must be inside a render pass instance begun with
+  // VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, or with
+  // VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT for dynamic
+  // rendering. inheritance describes that render pass instance. The previous
+  // frame of the slot must have completed.
+  void record(VkCommandBuffer primary, uint32_t frame, uint32_t image,
+              const VkCommandBufferInheritanceInfo &inheritance,
+              uint32_t drawCount, const RecordDraws &recordDraws);
+
+  // Forget the secondary command buffers of every image, e.g. after the
+  // swap chain has been recreated. They may still be pending: like the
+  // primary ones, they stay with their frame slot and are recorded again
+  // only once the slot's frame has completed.
+  void invalidate(uint32_t imageCount);
+
+  uint32_t threadCount() const { return threads; }
+
+private:
+  VkDevice device = VK_NULL_HANDLE;
+  ThreadPool *workers = nullptr;
+  uint32_t frameCount = 0;
+  uint32_t imageCount = 0;
+  uint32_t threads = 0;
+  // Indexed by frame * threads + thread
+  std::vector<VkCommandPool> commandPools;
+  // Indexed by (frame * imageCount + image) * threads + thread, allocated on
+  // first use from the pool of the frame and thread
+  std::vector<VkCommandBuffer> secondaries;
+  // Secondary command buffers of every (frame slot, thread) pair left over
+  // by invalidate(), indexed like commandPools
+  std::vector<std::vector<VkCommandBuffer>> spare;
+
+  VkCommandBuffer secondary(uint32_t frame, uint32_t image, uint32_t thread);
+};
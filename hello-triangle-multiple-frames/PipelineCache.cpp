@@ -0,0 +1,85 @@
+#include "PipelineCache.h"
+#include "FileUtils.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+// Size of VkPipelineCacheHeaderVersionOne as stored in the data
+static const size_t HEADER_SIZE = 16 + VK_UUID_SIZE;
+
+// The header fields are stored least significant byte first, whatever the
+// byte order of the host
+static uint32_t readLittleEndian(const std::vector<char> &data, size_t offset)
+{
+  uint32_t value = 0;
+  for (size_t i = 0; i < 4; i++)
+    value |= static_cast<uint32_t>(static_cast<uint8_t>(data[offset + i]))
+             << (8 * i);
+  return value;
+}
+
+bool isPipelineCacheCompatible(const std::vector<char> &data,
+                               const VkPhysicalDeviceProperties &properties)
+{
+  if (data.size() < HEADER_SIZE)
+    return false;
+
+  uint32_t headerSize = readLittleEndian(data, 0);
+  uint32_t headerVersion = readLittleEndian(data, 4);
+  uint32_t vendorID = readLittleEndian(data, 8);
+  uint32_t deviceID = readLittleEndian(data, 12);
+
+  return headerSize >= HEADER_SIZE && headerSize <= data.size() &&
+         headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         vendorID == properties.vendorID && deviceID == properties.deviceID &&
+         memcmp(data.data() + 16, properties.pipelineCacheUUID,
+                VK_UUID_SIZE) == 0;
+}
+
+VkPipelineCache loadPipelineCache(VkDevice device,
+                                  VkPhysicalDevice physicalDevice,
+                                  const std::string &filename, bool &loaded)
+{
+  std::vector<char> data;
+  std::ifstream file(filename, std::ios::binary);
+  if (file.is_open())
+    data.assign(std::istreambuf_iterator<char>(file),
+                std::istreambuf_iterator<char>());
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  loaded = isPipelineCacheCompatible(data, properties);
+
+  VkPipelineCacheCreateInfo createInfo{
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = 0,
+      .initialDataSize = loaded ? data.size() : 0,
+      .pInitialData = loaded ? data.data() : nullptr,
+  };
+
+  VkPipelineCache pipelineCache;
+  if (vkCreatePipelineCache(device, &createInfo, nullptr, &pipelineCache) !=
+      VK_SUCCESS)
+    throw std::runtime_error("failed to create pipeline cache!");
+
+  return pipelineCache;
+}
+
+void savePipelineCache(VkDevice device, VkPipelineCache pipelineCache,
+                       const std::string &filename)
+{
+  size_t size = 0;
+  if (vkGetPipelineCacheData(device, pipelineCache, &size, nullptr) !=
+      VK_SUCCESS)
+    throw std::runtime_error("failed to get pipeline cache data!");
+
+  std::vector<char> data(size);
+  if (vkGetPipelineCacheData(device, pipelineCache, &size, data.data()) !=
+      VK_SUCCESS)
+    throw std::runtime_error("failed to get pipeline cache data!");
+  data.resize(size);
+
+  writeFileAtomic(filename, data);
+}
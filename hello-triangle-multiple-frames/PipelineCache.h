@@ -0,0 +1,24 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <string>
+#include <vector>
+
+// Whether data starts with a pipeline cache header written by the device
+// described by properties: same header version, vendorID, deviceID and
+// pipelineCacheUUID. The UUID changes with the driver version, so data
+// written by another driver is rejected as well.
+bool isPipelineCacheCompatible(const std::vector<char> &data,
+                               const VkPhysicalDeviceProperties &properties);
+
+// Create a pipeline cache, filled with the contents of filename when the file
+// exists and was written by the same device and driver. Otherwise the cache
+// starts empty, as it does for an empty filename. loaded tells which of the
+// two happened.
+VkPipelineCache loadPipelineCache(VkDevice device,
+                                  VkPhysicalDevice physicalDevice,
+                                  const std::string &filename, bool &loaded);
+
+// Write the contents of pipelineCache to filename, atomically.
+void savePipelineCache(VkDevice device, VkPipelineCache pipelineCache,
+                       const std::string &filename);
@@ -0,0 +1,82 @@
+#include "PipelineCompiler.h"
+#include <exception>
+#include <stdexcept>
+
+void PipelineCompiler::init(VkDevice device, VkPipelineCache pipelineCache,
+                            ThreadPool &workers)
+{
+  this->device = device;
+  this->pipelineCache = pipelineCache;
+  this->workers = &workers;
+}
+
+std::future<VkPipeline>
+PipelineCompiler::compile(const VkGraphicsPipelineCreateInfo &createInfo)
+{
+  return workers->submit(
+      [device = device, pipelineCache = pipelineCache, createInfo]
+      {
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &createInfo,
+                                      nullptr, &pipeline) != VK_SUCCESS)
+          throw std::runtime_error("failed to create graphics pipeline!");
+
+        return pipeline;
+      });
+}
+
+std::future<VkPipeline>
+PipelineCompiler::compile(const VkComputePipelineCreateInfo &createInfo)
+{
+  return workers->submit(
+      [device = device, pipelineCache = pipelineCache, createInfo]
+      {
+        VkPipeline pipeline;
+        if (vkCreateComputePipelines(device, pipelineCache, 1, &createInfo,
+                                     nullptr, &pipeline) != VK_SUCCESS)
+          throw std::runtime_error("failed to create compute pipeline!");
+
+        return pipeline;
+      });
+}
+
+std::vector<std::future<VkPipeline>> PipelineCompiler::compile(
+    const std::vector<VkGraphicsPipelineCreateInfo> &createInfos)
+{
+  std::vector<std::future<VkPipeline>> pipelines;
+  for (const auto &createInfo : createInfos)
+    pipelines.push_back(compile(createInfo));
+
+  return pipelines;
+}
+
+std::vector<VkPipeline>
+PipelineCompiler::wait(std::vector<std::future<VkPipeline>> &pipelines)
+{
+  for (auto &pipeline : pipelines)
+    pipeline.wait();
+
+  std::vector<VkPipeline> results;
+  std::exception_ptr error;
+  for (auto &pipeline : pipelines)
+  {
+    try
+    {
+      results.push_back(pipeline.get());
+    }
+    catch (...)
+    {
+      if (!error)
+        error = std::current_exception();
+    }
+  }
+
+  if (error)
+  {
+    for (auto pipeline : results)
+      vkDestroyPipeline(device, pipeline, nullptr);
+    std::rethrow_exception(error);
+  }
+
+  return results;
+}
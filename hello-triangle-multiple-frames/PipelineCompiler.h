@@ -0,0 +1,47 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include "ThreadPool.h"
+#include <GLFW/glfw3.h>
+#include <future>
+#include <vector>
+
+// Compiles graphics and compute pipelines on the workers of a thread pool.
+// Pipeline compilation is by far the most expensive part of startup and
+// vkCreateGraphicsPipelines may be called from several threads at once, so
+// the permutations of a pipeline are compiled concurrently instead of one
+// after the other. They all share one VkPipelineCache, which is internally
+// synchronized, so a pipeline compiled on one worker speeds up the similar
+// ones compiled on the others.
+class PipelineCompiler
+{
+public:
+  void init(VkDevice device, VkPipelineCache pipelineCache,
+            ThreadPool &workers);
+
+  // Compile createInfo on a worker.
+  // The create info is copied, but everything it points to (shader stages,
+  // states, ...) must stay alive until the future is ready.
+  std::future<VkPipeline>
+  compile(const VkGraphicsPipelineCreateInfo &createInfo);
+
+  // Compile the compute pipeline of createInfo on a worker, under the same
+  // conditions
+  std::future<VkPipeline>
+  compile(const VkComputePipelineCreateInfo &createInfo);
+
+  // Compile every create info on its own worker
+  std::vector<std::future<VkPipeline>>
+  compile(const std::vector<VkGraphicsPipelineCreateInfo> &createInfos);
+
+  // Wait for all the pipelines and return them in order.
+  // Every future is waited for before an error is rethrown, so that no worker
+  // still reads the create infos once this returns. When a compilation
+  // fails, the pipelines that did compile are destroyed first.
+  std::vector<VkPipeline>
+  wait(std::vector<std::future<VkPipeline>> &pipelines);
+
+private:
+  VkDevice device = VK_NULL_HANDLE;
+  VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+  ThreadPool *workers = nullptr;
+};
@@ -0,0 +1,70 @@
+#include "PresentProfile.h"
+#include <stdexcept>
+
+const char *presentProfileName(PresentProfile profile)
+{
+  switch (profile)
+  {
+  case PresentProfile::LowestLatency:
+    return "lowest-latency";
+  case PresentProfile::Vsync:
+    return "vsync";
+  case PresentProfile::TearTolerant:
+    return "tear-tolerant";
+  case PresentProfile::PowerSaving:
+    return "power-saving";
+  }
+
+  return "unknown";
+}
+
+PresentProfile parsePresentProfile(const std::string &name)
+{
+  for (PresentProfile profile : PRESENT_PROFILES)
+    if (name == presentProfileName(profile))
+      return profile;
+
+  throw std::runtime_error("unknown present profile: " + name);
+}
+
+std::vector<VkPresentModeKHR> preferredPresentModes(PresentProfile profile)
+{
+  switch (profile)
+  {
+  case PresentProfile::LowestLatency:
+    return {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR,
+            VK_PRESENT_MODE_FIFO_KHR};
+  case PresentProfile::TearTolerant:
+    return {VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_FIFO_KHR};
+  case PresentProfile::Vsync:
+  case PresentProfile::PowerSaving:
+    break;
+  }
+
+  return {VK_PRESENT_MODE_FIFO_KHR};
+}
+
+const char *presentModeName(VkPresentModeKHR presentMode)
+{
+  switch (presentMode)
+  {
+  case VK_PRESENT_MODE_IMMEDIATE_KHR:
+    return "immediate";
+  case VK_PRESENT_MODE_MAILBOX_KHR:
+    return "mailbox";
+  case VK_PRESENT_MODE_FIFO_KHR:
+    return "fifo";
+  case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+    return "fifo-relaxed";
+  default:
+    return "other";
+  }
+}
+
+uint32_t presentProfileFrameCap(PresentProfile profile, uint32_t frameCap)
+{
+  if (frameCap == 0 && profile == PresentProfile::PowerSaving)
+    return POWER_SAVING_FRAME_CAP;
+
+  return frameCap;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// How frames are handed to the presentation engine, trading latency against
+// tearing and power.
+enum class PresentProfile
+{
+  // MAILBOX, or IMMEDIATE when there is no mailbox: frames are shown as soon
+  // as possible and the CPU never waits for the display
+  LowestLatency,
+  // FIFO: every frame is shown, synchronized with the display refresh
+  Vsync,
+  // FIFO_RELAXED: synchronized with the refresh, but a late frame is shown
+  // right away and may tear instead of waiting for the next refresh
+  TearTolerant,
+  // FIFO with a frame cap below the refresh rate, see
+  // POWER_SAVING_FRAME_CAP
+  PowerSaving,
+};
+
+inline const PresentProfile PRESENT_PROFILES[] = {
+    PresentProfile::LowestLatency,
+    PresentProfile::Vsync,
+    PresentProfile::TearTolerant,
+    PresentProfile::PowerSaving,
+};
+
+// Frames per second of the power-saving profile when no frame cap is given
+inline const uint32_t POWER_SAVING_FRAME_CAP = 30;
+
+// Name of the profile on the command line and in the benchmark report, e.g.
+// "lowest-latency"
+const char *presentProfileName(PresentProfile profile);
+// Profile named name. Throws std::runtime_error for unknown names.
+PresentProfile parsePresentProfile(const std::string &name);
+
+// Present modes of the profile, most preferred first. FIFO is always last:
+// it is the only mode every device supports.
+std::vector<VkPresentModeKHR> preferredPresentModes(PresentProfile profile);
+
+// Name of a present mode in the benchmark report, e.g. "mailbox"
+const char *presentModeName(VkPresentModeKHR presentMode);
+
+// Frames per second the profile is limited to, 0 for no limit. frameCap is
+// the limit given on the command line, 0 when none was given.
+uint32_t presentProfileFrameCap(PresentProfile profile, uint32_t frameCap);
@@ -1,6 +1,7 @@
+#pragma once
 #define GLFW_INCLUDE_VULKAN
+#include "VertexLayout.h"
 #include <GLFW/glfw3.h>
-#include <array>
 #include <glm/glm.hpp>
 #include <vector>
 
@@ -8,40 +9,58 @@ struct Vertex
 {
   glm::vec2 pos;
   glm::vec3 color;
+};
+
+// Vertex read with 32-bit floats
+using FloatVertexStream =
+    VertexStream<Vertex, 0, VK_VERTEX_INPUT_RATE_VERTEX,
+                 VertexAttribute<&Vertex::pos, offsetof(Vertex, pos), 0>,
+                 VertexAttribute<&Vertex::color, offsetof(Vertex, color), 1>>;
 
-  static VkVertexInputBindingDescription getBindingDescription()
-  {
-    VkVertexInputBindingDescription bindingDescription{
-        .binding = 0,
-        .stride = sizeof(Vertex),
-        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
-    };
-
-    return bindingDescription;
-  }
-
-  static std::array<VkVertexInputAttributeDescription, 2>
-  getAttributeDescriptions()
-  {
-    std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions = {
-        VkVertexInputAttributeDescription{
-            .location = 0,
-            .binding = 0,
-            .format = VK_FORMAT_R32G32_SFLOAT,
-            .offset = offsetof(Vertex, pos),
-        },
-        VkVertexInputAttributeDescription{
-            .location = 1,
-            .binding = 0,
-            .format = VK_FORMAT_R32G32B32_SFLOAT,
-            .offset = offsetof(Vertex, color),
-        },
-    };
-
-    return attributeDescriptions;
-  }
+// Vertex quantized to 8 bytes, see packVertices(). The shaders read the same
+// vec2 position and vec3 color as from Vertex, the vertex input converts them.
+struct PackedVertex
+{
+  // Two snorm16 or two half floats, see VertexFormat
+  uint16_t pos[2];
+  // RGBA unorm8
+  uint8_t color[4];
 };
 
+static_assert(sizeof(PackedVertex) == 8, "PackedVertex must not be padded");
+
+// PackedVertex with snorm16 positions
+using Snorm16VertexStream = VertexStream<
+    PackedVertex, 0, VK_VERTEX_INPUT_RATE_VERTEX,
+    VertexAttribute<&PackedVertex::pos, offsetof(PackedVertex, pos), 0,
+                    VK_FORMAT_R16G16_SNORM>,
+    VertexAttribute<&PackedVertex::color, offsetof(PackedVertex, color), 1,
+                    VK_FORMAT_R8G8B8A8_UNORM>>;
+
+// PackedVertex with half float positions
+using HalfVertexStream = VertexStream<
+    PackedVertex, 0, VK_VERTEX_INPUT_RATE_VERTEX,
+    VertexAttribute<&PackedVertex::pos, offsetof(PackedVertex, pos), 0,
+                    VK_FORMAT_R16G16_SFLOAT>,
+    VertexAttribute<&PackedVertex::color, offsetof(PackedVertex, color), 1,
+                    VK_FORMAT_R8G8B8A8_UNORM>>;
+
+// Per-instance data of the instanced mode, read from binding 1 once per
+// instance instead of once per vertex.
+struct InstanceData
+{
+  // x, y: offset in clip space, z: scale, w: rotation in radians
+  glm::vec4 transform;
+  // Multiplied with the vertex colors
+  glm::vec3 color;
+};
+
+using InstanceStream = VertexStream<
+    InstanceData, 1, VK_VERTEX_INPUT_RATE_INSTANCE,
+    VertexAttribute<&InstanceData::transform,
+                    offsetof(InstanceData, transform), 2>,
+    VertexAttribute<&InstanceData::color, offsetof(InstanceData, color), 3>>;
+
 const std::vector<Vertex> vertices = {
     {{-0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}},
     {{0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}},
@@ -0,0 +1,96 @@
+#include "StagingRing.h"
+#include "Memory.h"
+#include <stdexcept>
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void StagingRing::init(VkDevice device, MemoryAllocator &allocator,
+                       SubmissionTracker &tracker, VkDeviceSize size)
+{
+  this->device = device;
+  this->allocator = &allocator;
+  this->tracker = &tracker;
+  capacity = size;
+  head = tail = retiredHead = 0;
+
+  createBuffer(device, allocator, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+               MemoryUsage::Upload, buffer, allocation);
+}
+
+void StagingRing::destroy()
+{
+  destroyBuffer(device, *allocator, buffer, allocation);
+  inFlight.clear();
+}
+
+StagingRegion StagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+  if (size > capacity)
+    throw std::runtime_error("upload is larger than the staging ring!");
+
+  for (;;)
+  {
+    reclaim();
+
+    VkDeviceSize offset = alignUp(head, alignment);
+    bool fits;
+    if (head < tail)
+    {
+      fits = offset + size < tail;
+    }
+    else if (offset + size <= capacity)
+    {
+      fits = true;
+    }
+    else
+    {
+      // Skip the end of the buffer and continue at its start
+      offset = 0;
+      fits = size < tail;
+    }
+
+    if (fits)
+    {
+      head = offset + size;
+      return StagingRegion{
+          .buffer = buffer,
+          .offset = offset,
+          .mapped = static_cast<char *>(allocation.mapped) + offset,
+      };
+    }
+
+    if (inFlight.empty())
+      throw std::runtime_error(
+          "staging ring is full of uploads that were not submitted!");
+
+    tracker->wait(inFlight.front().serial);
+  }
+}
+
+void StagingRing::flush() { allocator->flush(allocation); }
+
+void StagingRing::retire(uint64_t serial)
+{
+  if (head == retiredHead)
+    return;
+
+  inFlight.push_back({serial, head});
+  retiredHead = head;
+}
+
+void StagingRing::reclaim()
+{
+  while (!inFlight.empty() && tracker->completed(inFlight.front().serial))
+  {
+    tail = inFlight.front().end;
+    inFlight.pop_front();
+  }
+
+  // Start over at the beginning of the buffer once everything is free, so
+  // large uploads do not have to wrap around
+  if (inFlight.empty() && head == retiredHead)
+    head = tail = retiredHead = 0;
+}
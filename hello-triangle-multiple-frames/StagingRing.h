@@ -0,0 +1,76 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include "MemoryAllocator.h"
+#include "SubmissionTracker.h"
+#include <GLFW/glfw3.h>
+#include <deque>
+
+// Size of the upload ring created at startup.
+inline const VkDeviceSize STAGING_RING_SIZE = 16ull * 1024 * 1024;
+
+// Space handed out by the StagingRing. Write the data to mapped, then copy
+// from buffer at offset.
+struct StagingRegion
+{
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  void *mapped = nullptr;
+};
+
+// Persistently mapped ring buffer for CPU to GPU uploads.
+// Instead of creating, mapping and destroying a staging buffer for every
+// upload, space is handed out linearly from one buffer created at startup,
+// so an upload only costs a memcpy and a copy command.
+// The space handed out since the last retire() belongs to the submission
+// passed to retire(), and it is reused once the tracker reports that
+// submission as completed. When the ring is full, allocate() waits for the
+// oldest submission that still uses it.
+class StagingRing
+{
+public:
+  void init(VkDevice device, MemoryAllocator &allocator,
+            SubmissionTracker &tracker, VkDeviceSize size);
+  void destroy();
+
+  // Allocate size bytes aligned to alignment, which must be a power of two.
+  // Throws when size is larger than the ring, or when the ring is full of
+  // space that has not been retired yet.
+  StagingRegion allocate(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+  // Make the writes to the ring visible to the device.
+  // Call before submitting the copies, it does nothing for coherent memory.
+  void flush();
+
+  // Tie the space allocated since the last call to the submission with
+  // serial on the queue of the tracker.
+  void retire(uint64_t serial);
+
+  VkDeviceSize size() const { return capacity; }
+
+private:
+  struct Region
+  {
+    uint64_t serial;
+    // Offset after the last byte of the region
+    VkDeviceSize end;
+  };
+
+  VkDevice device = VK_NULL_HANDLE;
+  MemoryAllocator *allocator = nullptr;
+  SubmissionTracker *tracker = nullptr;
+  VkBuffer buffer = VK_NULL_HANDLE;
+  Allocation allocation;
+  VkDeviceSize capacity = 0;
+  // Space in use goes from tail to head, wrapping at the end of the buffer.
+  // head == tail means that the ring is empty: allocate() never lets head
+  // catch up with tail from behind.
+  VkDeviceSize head = 0;
+  VkDeviceSize tail = 0;
+  // head at the last call to retire()
+  VkDeviceSize retiredHead = 0;
+  // Retired regions the GPU may still be reading, oldest first
+  std::deque<Region> inFlight;
+
+  // Free the regions whose submissions have completed
+  void reclaim();
+};
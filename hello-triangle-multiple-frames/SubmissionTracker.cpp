@@ -0,0 +1,198 @@
+#include "SubmissionTracker.h"
+#include <stdexcept>
+
+void SubmissionTracker::init(VkDevice device, VkQueue queue, bool timeline)
+{
+  this->device = device;
+  submitQueue = queue;
+  submittedSerial = 0;
+  completedSerial = 0;
+
+  if (!timeline)
+    return;
+
+  // Serial 0 is complete from the start
+  VkSemaphoreTypeCreateInfo typeInfo{
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+      .pNext = nullptr,
+      .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+      .initialValue = 0,
+  };
+  VkSemaphoreCreateInfo semaphoreInfo{
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+      .pNext = &typeInfo,
+  };
+
+  if (vkCreateSemaphore(device, &semaphoreInfo, nullptr,
+                        &timelineSemaphore) != VK_SUCCESS)
+    throw std::runtime_error("failed to create timeline semaphore!");
+}
+
+void SubmissionTracker::destroy()
+{
+  if (timelineSemaphore != VK_NULL_HANDLE)
+    vkDestroySemaphore(device, timelineSemaphore, nullptr);
+  timelineSemaphore = VK_NULL_HANDLE;
+
+  for (const auto &submission : pending)
+    vkDestroyFence(device, submission.fence, nullptr);
+  for (auto fence : freeFences)
+    vkDestroyFence(device, fence, nullptr);
+
+  pending.clear();
+  freeFences.clear();
+}
+
+uint64_t SubmissionTracker::submit(uint32_t submitCount,
+                                   const VkSubmitInfo *submits)
+{
+  if (timelineSemaphore != VK_NULL_HANDLE)
+    return submitTimeline(submitCount, submits);
+
+  VkFence fence;
+  if (!freeFences.empty())
+  {
+    fence = freeFences.back();
+    freeFences.pop_back();
+  }
+  else
+  {
+    VkFenceCreateInfo fenceInfo{
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+    };
+
+    if (vkCreateFence(device, &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+      throw std::runtime_error("failed to create submission fence!");
+  }
+
+  if (vkQueueSubmit(submitQueue, submitCount, submits, fence) != VK_SUCCESS)
+  {
+    freeFences.push_back(fence);
+    throw std::runtime_error("failed to submit command buffer!");
+  }
+
+  pending.push_back({++submittedSerial, fence});
+  return submittedSerial;
+}
+
+uint64_t SubmissionTracker::submitTimeline(uint32_t submitCount,
+                                           const VkSubmitInfo *submits)
+{
+  uint64_t serial = submittedSerial + 1;
+
+  // The last batch signals the timeline in addition to its own semaphores
+  timelineSubmits.assign(submits, submits + submitCount);
+  VkSubmitInfo &last = timelineSubmits.back();
+
+  const VkTimelineSemaphoreSubmitInfo *values = nullptr;
+  const void *next = last.pNext;
+  if (next != nullptr &&
+      static_cast<const VkBaseInStructure *>(next)->sType ==
+          VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO)
+  {
+    values = static_cast<const VkTimelineSemaphoreSubmitInfo *>(next);
+    next = values->pNext;
+  }
+
+  signalSemaphores.assign(last.pSignalSemaphores,
+                          last.pSignalSemaphores + last.signalSemaphoreCount);
+  signalSemaphores.push_back(timelineSemaphore);
+  // Values of binary semaphores are ignored
+  if (values != nullptr && values->signalSemaphoreValueCount > 0)
+    signalValues.assign(values->pSignalSemaphoreValues,
+                        values->pSignalSemaphoreValues +
+                            values->signalSemaphoreValueCount);
+  else
+    signalValues.assign(last.signalSemaphoreCount, 0);
+  signalValues.push_back(serial);
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo{
+      .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+      .pNext = next,
+      .waitSemaphoreValueCount =
+          values != nullptr ? values->waitSemaphoreValueCount : 0,
+      .pWaitSemaphoreValues =
+          values != nullptr ? values->pWaitSemaphoreValues : nullptr,
+      .signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size()),
+      .pSignalSemaphoreValues = signalValues.data(),
+  };
+  last.pNext = &timelineInfo;
+  last.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+  last.pSignalSemaphores = signalSemaphores.data();
+
+  if (vkQueueSubmit(submitQueue, submitCount, timelineSubmits.data(),
+                    VK_NULL_HANDLE) != VK_SUCCESS)
+    throw std::runtime_error("failed to submit command buffer!");
+
+  submittedSerial = serial;
+  return serial;
+}
+
+bool SubmissionTracker::completed(uint64_t serial)
+{
+  if (timelineSemaphore != VK_NULL_HANDLE)
+  {
+    if (serial > completedSerial &&
+        vkGetSemaphoreCounterValue(device, timelineSemaphore,
+                                   &completedSerial) != VK_SUCCESS)
+      throw std::runtime_error("failed to read timeline semaphore!");
+
+    return serial <= completedSerial;
+  }
+
+  while (serial > completedSerial && !pending.empty() &&
+         vkGetFenceStatus(device, pending.front().fence) == VK_SUCCESS)
+    retire(pending.front().serial);
+
+  return serial <= completedSerial;
+}
+
+void SubmissionTracker::wait(uint64_t serial)
+{
+  if (completed(serial))
+    return;
+
+  if (serial > submittedSerial)
+    throw std::runtime_error("waiting for a serial that was never submitted!");
+
+  if (timelineSemaphore != VK_NULL_HANDLE)
+  {
+    VkSemaphoreWaitInfo waitInfo{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+        .semaphoreCount = 1,
+        .pSemaphores = &timelineSemaphore,
+        .pValues = &serial,
+    };
+
+    if (vkWaitSemaphores(device, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+      throw std::runtime_error("failed to wait for timeline semaphore!");
+
+    completedSerial = serial;
+    return;
+  }
+
+  // Pending submissions have consecutive serials
+  VkFence fence = pending[serial - pending.front().serial].fence;
+  if (vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS)
+    throw std::runtime_error("failed to wait for submission fence!");
+
+  // Submissions complete in order, so the earlier ones are done as well
+  retire(serial);
+}
+
+void SubmissionTracker::retire(uint64_t serial)
+{
+  while (!pending.empty() && pending.front().serial <= serial)
+  {
+    VkFence fence = pending.front().fence;
+    pending.pop_front();
+    vkResetFences(device, 1, &fence);
+    freeFences.push_back(fence);
+  }
+
+  completedSerial = serial;
+}
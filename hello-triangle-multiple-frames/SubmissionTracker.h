@@ -0,0 +1,77 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Tracks the completion of the work submitted to a queue.
+// Every submission gets a serial, a number that increases by one with every
+// vkQueueSubmit. A queue executes its submissions in order, so knowing the
+// last completed serial is enough to know which resources the GPU is done
+// with: a resource used by the submission with serial s can be reused or
+// destroyed once completed(s) returns true.
+// Serial 0 is never returned by submit() and is always complete, so it can be
+// used for resources that were never submitted.
+//
+// With timeline semaphores (Vulkan 1.2), the serial is the value of a single
+// timeline semaphore signaled by the last batch of every submission, so
+// checking a serial is a comparison with the counter value and no fence is
+// ever reset. Without them, the tracker owns one fence per submission.
+// Signaled fences are reset and reused, so the number of fences only grows
+// with the number of submissions in flight.
+class SubmissionTracker
+{
+public:
+  void init(VkDevice device, VkQueue queue, bool timeline = false);
+  // Destroy the fences or the timeline semaphore. The queue must be idle.
+  void destroy();
+
+  VkQueue queue() const { return submitQueue; }
+
+  // Timeline semaphore whose value is the last completed serial, or
+  // VK_NULL_HANDLE when the tracker uses fences. Submissions to other queues
+  // can wait on it for a serial of this queue.
+  VkSemaphore semaphore() const { return timelineSemaphore; }
+
+  // Submit to the queue, returning the serial of the submission.
+  // In timeline mode the last VkSubmitInfo may start its pNext chain with a
+  // VkTimelineSemaphoreSubmitInfo, e.g. to wait on the timeline of another
+  // queue: the tracker adds its signal to it.
+  uint64_t submit(uint32_t submitCount, const VkSubmitInfo *submits);
+
+  // Serial of the last submission
+  uint64_t lastSubmitted() const { return submittedSerial; }
+
+  // Whether the submission with serial has completed. Does not block.
+  bool completed(uint64_t serial);
+  // Block until the submission with serial has completed
+  void wait(uint64_t serial);
+
+private:
+  struct Submission
+  {
+    uint64_t serial;
+    VkFence fence;
+  };
+
+  VkDevice device = VK_NULL_HANDLE;
+  VkQueue submitQueue = VK_NULL_HANDLE;
+  VkSemaphore timelineSemaphore = VK_NULL_HANDLE;
+  uint64_t submittedSerial = 0;
+  uint64_t completedSerial = 0;
+  // Submissions that have not been seen completing yet, oldest first
+  std::deque<Submission> pending;
+  std::vector<VkFence> freeFences;
+  // Copies of the submit infos extended with the timeline signal, kept to
+  // avoid allocating on every submission
+  std::vector<VkSubmitInfo> timelineSubmits;
+  std::vector<VkSemaphore> signalSemaphores;
+  std::vector<uint64_t> signalValues;
+
+  uint64_t submitTimeline(uint32_t submitCount, const VkSubmitInfo *submits);
+
+  // Retire the pending submissions up to serial, which must have completed,
+  // and recycle their fences
+  void retire(uint64_t serial);
+};
@@ -0,0 +1,38 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned threadCount)
+{
+  for (unsigned i = 0; i < threadCount; i++)
+    workers.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  condition.notify_all();
+
+  for (auto &worker : workers)
+    worker.join();
+}
+
+void ThreadPool::work()
+{
+  for (;;)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      condition.wait(lock, [this] { return stopping || !tasks.empty(); });
+      if (tasks.empty())
+        return;
+
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+
+    task();
+  }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running tasks in the order they are submitted.
+// submit() returns a future of the result of the task. Exceptions thrown by
+// a task are stored in its future and rethrown by get().
+// The destructor runs the tasks still queued and joins the workers.
+class ThreadPool
+{
+public:
+  explicit ThreadPool(
+      unsigned threadCount = std::max(1u, std::thread::hardware_concurrency()));
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+  template <typename Task>
+  auto submit(Task task) -> std::future<decltype(task())>
+  {
+    // std::function needs a copyable target, a packaged_task is move-only
+    auto packaged =
+        std::make_shared<std::packaged_task<decltype(task())()>>(
+            std::move(task));
+    auto future = packaged->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.emplace_back([packaged] { (*packaged)(); });
+    }
+    condition.notify_one();
+    return future;
+  }
+
+private:
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool stopping = false;
+
+  void work();
+};
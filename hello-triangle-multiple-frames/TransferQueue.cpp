@@ -0,0 +1,397 @@
+#include "TransferQueue.h"
+#include <stdexcept>
+
+static const VkImageSubresourceRange COLOR_SUBRESOURCE_RANGE{
+    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+    .baseMipLevel = 0,
+    .levelCount = 1,
+    .baseArrayLayer = 0,
+    .layerCount = 1,
+};
+
+void TransferBatch::copyBuffer(VkBuffer src, VkDeviceSize srcOffset,
+                               VkBuffer dst, VkDeviceSize dstOffset,
+                               VkDeviceSize size, VkPipelineStageFlags dstStage,
+                               VkAccessFlags dstAccess)
+{
+  bufferCopies.push_back({
+      .src = src,
+      .dst = dst,
+      .region = {.srcOffset = srcOffset, .dstOffset = dstOffset, .size = size},
+      .dstAccess = dstAccess,
+  });
+  dstStages |= dstStage;
+}
+
+void TransferBatch::copyBufferToImage(VkBuffer src, VkDeviceSize srcOffset,
+                                      VkImage dst, VkExtent3D extent,
+                                      VkImageLayout finalLayout,
+                                      VkPipelineStageFlags dstStage,
+                                      VkAccessFlags dstAccess)
+{
+  imageCopies.push_back({
+      .src = src,
+      .dst = dst,
+      .region =
+          {
+              .bufferOffset = srcOffset,
+              .bufferRowLength = 0, // 0 means tightly packed
+              .bufferImageHeight = 0,
+              .imageSubresource =
+                  {
+                      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                      .mipLevel = 0,
+                      .baseArrayLayer = 0,
+                      .layerCount = 1,
+                  },
+              .imageOffset = {0, 0, 0},
+              .imageExtent = extent,
+          },
+      .finalLayout = finalLayout,
+      .dstAccess = dstAccess,
+  });
+  dstStages |= dstStage;
+}
+
+void TransferBatch::clear()
+{
+  bufferCopies.clear();
+  imageCopies.clear();
+  dstStages = 0;
+}
+
+void TransferQueue::init(VkDevice device,
+                         SubmissionTracker &graphicsSubmissions,
+                         uint32_t graphicsFamily,
+                         SubmissionTracker *transferSubmissions,
+                         uint32_t transferFamily)
+{
+  this->device = device;
+  this->graphicsSubmissions = &graphicsSubmissions;
+  this->transferSubmissions = transferSubmissions;
+  this->graphicsFamily = graphicsFamily;
+  this->transferFamily = transferFamily;
+
+  graphicsPool = createPool(graphicsFamily);
+  if (dedicated())
+    transferPool = createPool(transferFamily);
+}
+
+void TransferQueue::destroy()
+{
+  // Destroying the pools frees their command buffers
+  for (const auto &submission : inFlight)
+    if (submission.semaphore != VK_NULL_HANDLE)
+      vkDestroySemaphore(device, submission.semaphore, nullptr);
+  for (auto semaphore : freeSemaphores)
+    vkDestroySemaphore(device, semaphore, nullptr);
+  inFlight.clear();
+  freeSemaphores.clear();
+
+  vkDestroyCommandPool(device, graphicsPool, nullptr);
+  if (transferPool != VK_NULL_HANDLE)
+    vkDestroyCommandPool(device, transferPool, nullptr);
+  graphicsPool = transferPool = VK_NULL_HANDLE;
+}
+
+uint64_t TransferQueue::submit(TransferBatch &batch)
+{
+  collect();
+
+  if (batch.empty())
+    return 0;
+
+  Submission submission{
+      .serial = 0,
+      .transferSerial = 0,
+      .transferCommands = VK_NULL_HANDLE,
+      .graphicsCommands = beginCommands(graphicsPool),
+      .semaphore = VK_NULL_HANDLE,
+  };
+
+  if (!dedicated())
+  {
+    recordCopies(submission.graphicsCommands, batch);
+    recordBarriers(submission.graphicsCommands, batch, BarrierKind::SameQueue);
+
+    if (vkEndCommandBuffer(submission.graphicsCommands) != VK_SUCCESS)
+      throw std::runtime_error("failed to record upload command buffer!");
+
+    VkSubmitInfo submitInfo{.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                            .pNext = nullptr,
+                            .waitSemaphoreCount = 0,
+                            .pWaitSemaphores = nullptr,
+                            .pWaitDstStageMask = nullptr,
+                            .commandBufferCount = 1,
+                            .pCommandBuffers = &submission.graphicsCommands,
+                            .signalSemaphoreCount = 0,
+                            .pSignalSemaphores = nullptr};
+    submission.serial = graphicsSubmissions->submit(1, &submitInfo);
+  }
+  else
+  {
+    // The timeline of the transfer queue replaces the binary semaphore
+    VkSemaphore timeline = transferSubmissions->semaphore();
+    submission.transferCommands = beginCommands(transferPool);
+    if (timeline == VK_NULL_HANDLE)
+      submission.semaphore = acquireSemaphore();
+
+    recordCopies(submission.transferCommands, batch);
+    recordBarriers(submission.transferCommands, batch, BarrierKind::Release);
+
+    if (vkEndCommandBuffer(submission.transferCommands) != VK_SUCCESS)
+      throw std::runtime_error("failed to record upload command buffer!");
+
+    VkSubmitInfo transferSubmit{
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = nullptr,
+        .waitSemaphoreCount = 0,
+        .pWaitSemaphores = nullptr,
+        .pWaitDstStageMask = nullptr,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &submission.transferCommands,
+        .signalSemaphoreCount = timeline == VK_NULL_HANDLE ? 1u : 0u,
+        .pSignalSemaphores = &submission.semaphore};
+    submission.transferSerial =
+        transferSubmissions->submit(1, &transferSubmit);
+
+    recordBarriers(submission.graphicsCommands, batch, BarrierKind::Acquire);
+
+    if (vkEndCommandBuffer(submission.graphicsCommands) != VK_SUCCESS)
+      throw std::runtime_error("failed to record upload command buffer!");
+
+    VkTimelineSemaphoreSubmitInfo timelineWait{
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .pNext = nullptr,
+        .waitSemaphoreValueCount = 1,
+        .pWaitSemaphoreValues = &submission.transferSerial,
+        .signalSemaphoreValueCount = 0,
+        .pSignalSemaphoreValues = nullptr,
+    };
+    VkSubmitInfo graphicsSubmit{
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = timeline == VK_NULL_HANDLE ? nullptr : &timelineWait,
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores =
+            timeline == VK_NULL_HANDLE ? &submission.semaphore : &timeline,
+        .pWaitDstStageMask = &batch.dstStages,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &submission.graphicsCommands,
+        .signalSemaphoreCount = 0,
+        .pSignalSemaphores = nullptr};
+    submission.serial = graphicsSubmissions->submit(1, &graphicsSubmit);
+  }
+
+  inFlight.push_back(submission);
+  batch.clear();
+  return submission.serial;
+}
+
+bool TransferQueue::completed(uint64_t serial)
+{
+  return graphicsSubmissions->completed(serial);
+}
+
+void TransferQueue::wait(uint64_t serial) { graphicsSubmissions->wait(serial); }
+
+void TransferQueue::recordCopies(VkCommandBuffer commandBuffer,
+                                 const TransferBatch &batch)
+{
+  // Images are written as a whole, so their previous contents do not need to
+  // be preserved by the transition
+  std::vector<VkImageMemoryBarrier> transitions;
+  for (const auto &copy : batch.imageCopies)
+    transitions.push_back({
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = 0,
+        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = copy.dst,
+        .subresourceRange = COLOR_SUBRESOURCE_RANGE,
+    });
+
+  if (!transitions.empty())
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, static_cast<uint32_t>(transitions.size()),
+                         transitions.data());
+
+  // Consecutive copies between the same buffers become a single command
+  std::vector<VkBufferCopy> regions;
+  for (size_t i = 0; i < batch.bufferCopies.size(); i++)
+  {
+    const auto &copy = batch.bufferCopies[i];
+    regions.push_back(copy.region);
+
+    if (i + 1 < batch.bufferCopies.size() &&
+        batch.bufferCopies[i + 1].src == copy.src &&
+        batch.bufferCopies[i + 1].dst == copy.dst)
+      continue;
+
+    vkCmdCopyBuffer(commandBuffer, copy.src, copy.dst,
+                    static_cast<uint32_t>(regions.size()), regions.data());
+    regions.clear();
+  }
+
+  for (const auto &copy : batch.imageCopies)
+    vkCmdCopyBufferToImage(commandBuffer, copy.src, copy.dst,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                           &copy.region);
+}
+
+void TransferQueue::recordBarriers(VkCommandBuffer commandBuffer,
+                                   const TransferBatch &batch,
+                                   BarrierKind kind)
+{
+  // The destination access of a release and the source access of an acquire
+  // are ignored, the release makes the writes available and the acquire
+  // makes them visible
+  VkAccessFlags srcAccess =
+      kind == BarrierKind::Acquire ? 0 : VK_ACCESS_TRANSFER_WRITE_BIT;
+  bool visible = kind != BarrierKind::Release;
+  uint32_t srcFamily = kind == BarrierKind::SameQueue ? VK_QUEUE_FAMILY_IGNORED
+                                                      : transferFamily;
+  uint32_t dstFamily = kind == BarrierKind::SameQueue ? VK_QUEUE_FAMILY_IGNORED
+                                                      : graphicsFamily;
+
+  std::vector<VkBufferMemoryBarrier> bufferBarriers;
+  for (const auto &copy : batch.bufferCopies)
+    bufferBarriers.push_back({
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = srcAccess,
+        .dstAccessMask = visible ? copy.dstAccess : 0,
+        .srcQueueFamilyIndex = srcFamily,
+        .dstQueueFamilyIndex = dstFamily,
+        .buffer = copy.dst,
+        .offset = copy.region.dstOffset,
+        .size = copy.region.size,
+    });
+
+  // Both halves of an ownership transfer perform the same layout transition
+  std::vector<VkImageMemoryBarrier> imageBarriers;
+  for (const auto &copy : batch.imageCopies)
+    imageBarriers.push_back({
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .pNext = nullptr,
+        .srcAccessMask = srcAccess,
+        .dstAccessMask = visible ? copy.dstAccess : 0,
+        .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .newLayout = copy.finalLayout,
+        .srcQueueFamilyIndex = srcFamily,
+        .dstQueueFamilyIndex = dstFamily,
+        .image = copy.dst,
+        .subresourceRange = COLOR_SUBRESOURCE_RANGE,
+    });
+
+  // An acquire waits for the semaphore at the stages that read the data, so
+  // it is ordered after the wait by using the same stages
+  VkPipelineStageFlags srcStage =
+      kind == BarrierKind::Acquire
+          ? batch.dstStages
+          : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TRANSFER_BIT);
+  VkPipelineStageFlags dstStage =
+      kind == BarrierKind::Release
+          ? static_cast<VkPipelineStageFlags>(
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT)
+          : batch.dstStages;
+
+  vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr,
+                       static_cast<uint32_t>(bufferBarriers.size()),
+                       bufferBarriers.data(),
+                       static_cast<uint32_t>(imageBarriers.size()),
+                       imageBarriers.data());
+}
+
+VkCommandPool TransferQueue::createPool(uint32_t queueFamily)
+{
+  VkCommandPoolCreateInfo poolInfo{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+      .pNext = nullptr,
+      .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+      .queueFamilyIndex = queueFamily,
+  };
+
+  VkCommandPool pool;
+  if (vkCreateCommandPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+    throw std::runtime_error("failed to create upload command pool!");
+
+  return pool;
+}
+
+VkCommandBuffer TransferQueue::beginCommands(VkCommandPool pool)
+{
+  VkCommandBufferAllocateInfo allocInfo{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .pNext = nullptr,
+      .commandPool = pool,
+      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = 1,
+  };
+
+  VkCommandBuffer commandBuffer;
+  if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) !=
+      VK_SUCCESS)
+    throw std::runtime_error("failed to allocate upload command buffer!");
+
+  VkCommandBufferBeginInfo beginInfo{
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .pNext = nullptr,
+      .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+      .pInheritanceInfo = nullptr,
+  };
+
+  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+    throw std::runtime_error("failed to begin recording upload commands!");
+
+  return commandBuffer;
+}
+
+VkSemaphore TransferQueue::acquireSemaphore()
+{
+  if (!freeSemaphores.empty())
+  {
+    VkSemaphore semaphore = freeSemaphores.back();
+    freeSemaphores.pop_back();
+    return semaphore;
+  }
+
+  VkSemaphoreCreateInfo semaphoreInfo{
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+      .pNext = nullptr,
+  };
+
+  VkSemaphore semaphore;
+  if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) !=
+      VK_SUCCESS)
+    throw std::runtime_error("failed to create upload semaphore!");
+
+  return semaphore;
+}
+
+void TransferQueue::collect()
+{
+  // The graphics submission waited for the transfer submission, so both are
+  // done once the graphics serial has completed. The semaphore has been
+  // waited on and is unsignaled again.
+  while (!inFlight.empty() &&
+         graphicsSubmissions->completed(inFlight.front().serial))
+  {
+    const Submission &submission = inFlight.front();
+    // Lets the transfer tracker retire the submission and recycle its fence
+    if (submission.transferSerial != 0)
+      transferSubmissions->completed(submission.transferSerial);
+    vkFreeCommandBuffers(device, graphicsPool, 1,
+                         &submission.graphicsCommands);
+    if (submission.transferCommands != VK_NULL_HANDLE)
+      vkFreeCommandBuffers(device, transferPool, 1,
+                           &submission.transferCommands);
+    if (submission.semaphore != VK_NULL_HANDLE)
+      freeSemaphores.push_back(submission.semaphore);
+    inFlight.pop_front();
+  }
+}
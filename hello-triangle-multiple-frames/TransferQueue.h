@@ -0,0 +1,140 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include "StagingRing.h"
+#include "SubmissionTracker.h"
+#include <GLFW/glfw3.h>
+#include <deque>
+#include <vector>
+
+// Copies collected for a single submission, see TransferQueue::submit().
+// Every copy names the pipeline stage and access that read its destination
+// on the graphics queue, so that the data can be made visible to them.
+// Destinations must have been created with VK_SHARING_MODE_EXCLUSIVE.
+class TransferBatch
+{
+public:
+  void copyBuffer(VkBuffer src, VkDeviceSize srcOffset, VkBuffer dst,
+                  VkDeviceSize dstOffset, VkDeviceSize size,
+                  VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+  // Copy tightly packed texels to the first mip level and layer of the color
+  // image dst. The previous contents of the image are discarded and it ends
+  // up in finalLayout.
+  void copyBufferToImage(VkBuffer src, VkDeviceSize srcOffset, VkImage dst,
+                         VkExtent3D extent, VkImageLayout finalLayout,
+                         VkPipelineStageFlags dstStage,
+                         VkAccessFlags dstAccess);
+
+  bool empty() const { return bufferCopies.empty() && imageCopies.empty(); }
+  void clear();
+
+private:
+  friend class TransferQueue;
+
+  struct BufferCopy
+  {
+    VkBuffer src;
+    VkBuffer dst;
+    VkBufferCopy region;
+    VkAccessFlags dstAccess;
+  };
+
+  struct ImageCopy
+  {
+    VkBuffer src;
+    VkImage dst;
+    VkBufferImageCopy region;
+    VkImageLayout finalLayout;
+    VkAccessFlags dstAccess;
+  };
+
+  std::vector<BufferCopy> bufferCopies;
+  std::vector<ImageCopy> imageCopies;
+  // Union of the stages that read the destinations
+  VkPipelineStageFlags dstStages = 0;
+};
+
+// Uploads data from the staging ring to device local resources.
+// All the copies of a batch are recorded into one command buffer and
+// submitted at once, so loading many resources costs a single submission.
+// When the device has a queue family that supports transfers but not
+// graphics, the copies run on it, in parallel with rendering:
+// - the copies are recorded for the transfer queue, followed by barriers that
+//   release the ownership of the destinations to the graphics queue family,
+// - the transfer submission signals a semaphore, or the timeline of the
+//   transfer queue when the trackers use timeline semaphores,
+// - a small graphics submission waits for the semaphore (or the serial of the
+//   transfer submission on that timeline) and acquires the ownership with
+//   the matching barriers, which also makes the data visible to the stages
+//   that read it.
+// Without such a family the copies and plain barriers are submitted to the
+// graphics queue instead.
+// Either way the CPU never waits: submit() returns the serial of the last
+// graphics submission of the batch, after which the staging space can be
+// reused, and every later graphics submission sees the uploaded data.
+class TransferQueue
+{
+public:
+  // transferSubmissions is nullptr when there is no dedicated transfer queue
+  void init(VkDevice device, SubmissionTracker &graphicsSubmissions,
+            uint32_t graphicsFamily, SubmissionTracker *transferSubmissions,
+            uint32_t transferFamily);
+  // The queues must be idle
+  void destroy();
+
+  bool dedicated() const { return transferSubmissions != nullptr; }
+
+  // Submit the copies of batch and clear it. Returns the serial on the
+  // graphics queue after which the copies are complete, 0 for an empty batch.
+  uint64_t submit(TransferBatch &batch);
+
+  // Whether the batch submitted with serial has completed, without blocking
+  bool completed(uint64_t serial);
+  // Block until the batch submitted with serial has completed
+  void wait(uint64_t serial);
+
+private:
+  // Resources of a submitted batch, freed once its graphics serial has
+  // completed
+  struct Submission
+  {
+    uint64_t serial;
+    // Serial on the transfer queue, 0 without a dedicated queue
+    uint64_t transferSerial;
+    VkCommandBuffer transferCommands;
+    VkCommandBuffer graphicsCommands;
+    VkSemaphore semaphore;
+  };
+
+  VkDevice device = VK_NULL_HANDLE;
+  SubmissionTracker *graphicsSubmissions = nullptr;
+  SubmissionTracker *transferSubmissions = nullptr;
+  uint32_t graphicsFamily = 0;
+  uint32_t transferFamily = 0;
+  VkCommandPool graphicsPool = VK_NULL_HANDLE;
+  VkCommandPool transferPool = VK_NULL_HANDLE;
+  std::deque<Submission> inFlight;
+  std::vector<VkSemaphore> freeSemaphores;
+
+  // Half of a queue family ownership transfer, or a plain barrier when the
+  // copies and their readers are on the same queue
+  enum class BarrierKind
+  {
+    SameQueue,
+    Release,
+    Acquire,
+  };
+
+  // Record the copies of batch, with the layout transitions of the images
+  // they write to
+  void recordCopies(VkCommandBuffer commandBuffer, const TransferBatch &batch);
+  // Record the barriers that hand the destinations of batch from the copies
+  // to their readers
+  void recordBarriers(VkCommandBuffer commandBuffer, const TransferBatch &batch,
+                      BarrierKind kind);
+  VkCommandPool createPool(uint32_t queueFamily);
+  VkCommandBuffer beginCommands(VkCommandPool pool);
+  VkSemaphore acquireSemaphore();
+  // Free the resources of the batches that have completed
+  void collect();
+};
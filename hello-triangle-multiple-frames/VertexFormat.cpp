@@ -0,0 +1,26 @@
+#include "VertexFormat.h"
+#include <stdexcept>
+
+const char *vertexFormatName(VertexFormat format)
+{
+  switch (format)
+  {
+  case VertexFormat::Float:
+    return "float";
+  case VertexFormat::Snorm16:
+    return "snorm16";
+  case VertexFormat::Half:
+    return "half";
+  }
+
+  return "unknown";
+}
+
+VertexFormat parseVertexFormat(const std::string &name)
+{
+  for (VertexFormat format : VERTEX_FORMATS)
+    if (name == vertexFormatName(format))
+      return format;
+
+  throw std::runtime_error("unknown vertex format: " + name);
+}
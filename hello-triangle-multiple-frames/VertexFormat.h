@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+
+// How the vertices of the meshes are stored in the geometry pool.
+enum class VertexFormat
+{
+  // Vertex: 32-bit float position and color, 20 bytes
+  Float,
+  // PackedVertex with snorm16 positions, for meshes inside [-1, 1]
+  Snorm16,
+  // PackedVertex with half float positions, for meshes of any size
+  Half,
+};
+
+inline const VertexFormat VERTEX_FORMATS[] = {
+    VertexFormat::Float,
+    VertexFormat::Snorm16,
+    VertexFormat::Half,
+};
+
+// Name of the format on the command line and in the benchmark report, e.g.
+// "snorm16"
+const char *vertexFormatName(VertexFormat format);
+// Format named name. Throws std::runtime_error for unknown names.
+VertexFormat parseVertexFormat(const std::string &name);
@@ -0,0 +1,261 @@
+#pragma once
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <type_traits>
+#include <vector>
+
+// Vertex input descriptions derived at compile time from a declared list of
+// attributes, so that the formats, offsets and strides can not drift apart
+// from the vertex structs. A layout is declared once as a type:
+//
+//   using MyStream = VertexStream<
+//       MyVertex, 0, VK_VERTEX_INPUT_RATE_VERTEX,
+//       VertexAttribute<&MyVertex::pos, offsetof(MyVertex, pos), 0>,
+//       VertexAttribute<&MyVertex::color, offsetof(MyVertex, color), 1>>;
+//
+// Several streams are combined with VertexLayout, e.g. a position-only
+// stream on its own binding for depth or shadow passes and a second stream
+// with the remaining attributes for the passes that shade.
+
+// Size of an attribute of the format, 0 for the formats a layout can not use
+constexpr uint32_t vertexFormatSize(VkFormat format)
+{
+  switch (format)
+  {
+  case VK_FORMAT_R32_SFLOAT:
+  case VK_FORMAT_R32_UINT:
+  case VK_FORMAT_R16G16_SNORM:
+  case VK_FORMAT_R16G16_SFLOAT:
+  case VK_FORMAT_R8G8B8A8_UNORM:
+  case VK_FORMAT_R8G8B8A8_SNORM:
+    return 4;
+  case VK_FORMAT_R32G32_SFLOAT:
+  case VK_FORMAT_R16G16B16A16_SNORM:
+  case VK_FORMAT_R16G16B16A16_SFLOAT:
+    return 8;
+  case VK_FORMAT_R32G32B32_SFLOAT:
+    return 12;
+  case VK_FORMAT_R32G32B32A32_SFLOAT:
+    return 16;
+  default:
+    return 0;
+  }
+}
+
+// Format a member of type T is read with when the attribute does not name
+// one. Packed members like uint16_t[2] have no default, their attributes
+// must name the format.
+template <typename T>
+struct DefaultVertexFormat
+{
+  static constexpr VkFormat value = VK_FORMAT_UNDEFINED;
+};
+
+template <>
+struct DefaultVertexFormat<float>
+{
+  static constexpr VkFormat value = VK_FORMAT_R32_SFLOAT;
+};
+
+template <>
+struct DefaultVertexFormat<uint32_t>
+{
+  static constexpr VkFormat value = VK_FORMAT_R32_UINT;
+};
+
+template <>
+struct DefaultVertexFormat<glm::vec2>
+{
+  static constexpr VkFormat value = VK_FORMAT_R32G32_SFLOAT;
+};
+
+template <>
+struct DefaultVertexFormat<glm::vec3>
+{
+  static constexpr VkFormat value = VK_FORMAT_R32G32B32_SFLOAT;
+};
+
+template <>
+struct DefaultVertexFormat<glm::vec4>
+{
+  static constexpr VkFormat value = VK_FORMAT_R32G32B32A32_SFLOAT;
+};
+
+// Struct and type of the member a member pointer points to
+template <typename MemberPointer>
+struct VertexMember;
+
+template <typename Struct, typename Type>
+struct VertexMember<Type Struct::*>
+{
+  using StructType = Struct;
+  using MemberType = Type;
+};
+
+// The member Member of a vertex struct, at offset Offset, read by the
+// shaders from location Location with the format Format. Offset is
+// offsetof() of the same member: a member pointer can not be turned into an
+// offset at compile time. The member pointer gives the type the format is
+// checked against, and VertexStream checks that the offsets lie inside the
+// struct without overlapping.
+template <auto Member, size_t Offset, uint32_t Location,
+          VkFormat Format = DefaultVertexFormat<
+              typename VertexMember<decltype(Member)>::MemberType>::value>
+struct VertexAttribute
+{
+  using Struct = typename VertexMember<decltype(Member)>::StructType;
+  using Type = typename VertexMember<decltype(Member)>::MemberType;
+
+  static_assert(vertexFormatSize(Format) != 0,
+                "unsupported vertex attribute format");
+  static_assert(vertexFormatSize(Format) == sizeof(Type),
+                "vertex attribute format does not match the member size");
+
+  static constexpr uint32_t location = Location;
+  static constexpr uint32_t offset = static_cast<uint32_t>(Offset);
+  static constexpr uint32_t size = sizeof(Type);
+  static constexpr VkFormat format = Format;
+
+  static constexpr VkVertexInputAttributeDescription
+  description(uint32_t binding)
+  {
+    return VkVertexInputAttributeDescription{
+        .location = Location,
+        .binding = binding,
+        .format = Format,
+        .offset = offset,
+    };
+  }
+};
+
+// Whether no two values are equal
+template <size_t N>
+constexpr bool allDifferent(const std::array<uint32_t, N> &values)
+{
+  for (size_t i = 0; i < N; i++)
+    for (size_t j = i + 1; j < N; j++)
+      if (values[i] == values[j])
+        return false;
+
+  return true;
+}
+
+// Whether the ranges [offsets[i], offsets[i] + sizes[i]) all lie inside
+// [0, end) and no two of them overlap
+template <size_t N>
+constexpr bool disjointRanges(const std::array<uint32_t, N> &offsets,
+                              const std::array<uint32_t, N> &sizes,
+                              size_t end)
+{
+  for (size_t i = 0; i < N; i++)
+  {
+    if (offsets[i] + sizes[i] > end)
+      return false;
+    for (size_t j = i + 1; j < N; j++)
+      if (offsets[i] < offsets[j] + sizes[j] &&
+          offsets[j] < offsets[i] + sizes[i])
+        return false;
+  }
+
+  return true;
+}
+
+// The attributes of one vertex buffer binding. Every attribute is a member
+// of Struct, the buffer holds one Struct per vertex or per instance.
+template <typename Struct, uint32_t Binding, VkVertexInputRate InputRate,
+          typename... Attributes>
+struct VertexStream
+{
+  static_assert(sizeof...(Attributes) > 0, "a vertex stream needs attributes");
+  static_assert((std::is_same_v<typename Attributes::Struct, Struct> && ...),
+                "vertex attribute of another struct");
+  static_assert(allDifferent(
+                    std::array<uint32_t, sizeof...(Attributes)>{
+                        Attributes::location...}),
+                "vertex attributes share a location");
+  static_assert(
+      disjointRanges(
+          std::array<uint32_t, sizeof...(Attributes)>{Attributes::offset...},
+          std::array<uint32_t, sizeof...(Attributes)>{Attributes::size...},
+          sizeof(Struct)),
+      "vertex attribute offsets overlap or lie outside the struct");
+
+  static constexpr uint32_t binding = Binding;
+  static constexpr size_t attributeCount = sizeof...(Attributes);
+  static constexpr std::array<uint32_t, sizeof...(Attributes)> locations = {
+      Attributes::location...};
+
+  static constexpr VkVertexInputBindingDescription getBindingDescription()
+  {
+    return VkVertexInputBindingDescription{
+        .binding = Binding,
+        .stride = sizeof(Struct),
+        .inputRate = InputRate,
+    };
+  }
+
+  static constexpr std::array<VkVertexInputAttributeDescription,
+                              sizeof...(Attributes)>
+  getAttributeDescriptions()
+  {
+    return {Attributes::description(Binding)...};
+  }
+
+  // Add the binding and the attributes of the stream to the descriptions of
+  // a pipeline
+  static void
+  append(std::vector<VkVertexInputBindingDescription> &bindings,
+         std::vector<VkVertexInputAttributeDescription> &attributes)
+  {
+    bindings.push_back(getBindingDescription());
+    auto descriptions = getAttributeDescriptions();
+    attributes.insert(attributes.end(), descriptions.begin(),
+                      descriptions.end());
+  }
+};
+
+// Copy the locations of a stream to all from index next on, returns the
+// index after the last copied location
+template <size_t N, size_t M>
+constexpr size_t copyLocations(std::array<uint32_t, N> &all, size_t next,
+                               const std::array<uint32_t, M> &locations)
+{
+  for (size_t i = 0; i < M; i++)
+    all[next + i] = locations[i];
+
+  return next + M;
+}
+
+// Every location of every stream
+template <typename... Streams>
+constexpr std::array<uint32_t, (Streams::attributeCount + ... + 0)>
+vertexLocations()
+{
+  std::array<uint32_t, (Streams::attributeCount + ... + 0)> all{};
+  size_t next = 0;
+  ((next = copyLocations(all, next, Streams::locations)), ...);
+
+  return all;
+}
+
+// Streams read together by one pipeline, each from its own binding
+template <typename... Streams>
+struct VertexLayout
+{
+  static_assert(allDifferent(std::array<uint32_t, sizeof...(Streams)>{
+                    Streams::binding...}),
+                "vertex streams share a binding");
+  static_assert(allDifferent(vertexLocations<Streams...>()),
+                "vertex streams share a location");
+
+  static void
+  append(std::vector<VkVertexInputBindingDescription> &bindings,
+         std::vector<VkVertexInputAttributeDescription> &attributes)
+  {
+    (Streams::append(bindings, attributes), ...);
+  }
+};
@@ -0,0 +1,148 @@
+#include "VertexPacking.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/packing.hpp>
+#include <stdexcept>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+uint32_t vertexStride(VertexFormat format)
+{
+  return format == VertexFormat::Float ? sizeof(Vertex) : sizeof(PackedVertex);
+}
+
+// The snorm and unorm conversions round in the current rounding mode, like
+// the SSE conversions, so both paths produce the same bits.
+static uint16_t packSnorm16(float value)
+{
+  return static_cast<uint16_t>(static_cast<int16_t>(
+      std::nearbyint(std::clamp(value, -1.0f, 1.0f) * 32767.0f)));
+}
+
+static uint8_t packUnorm8(float value)
+{
+  return static_cast<uint8_t>(
+      std::nearbyint(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+}
+
+// glm::packHalf1x16 does not round like F16C, so every half float of both
+// paths is converted here
+static uint16_t packHalf(float value)
+{
+#ifdef __F16C__
+  return _cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT);
+#else
+  return glm::packHalf1x16(value);
+#endif
+}
+
+static PackedVertex packVertex(const Vertex &vertex, VertexFormat format)
+{
+  PackedVertex packed;
+  if (format == VertexFormat::Half)
+  {
+    packed.pos[0] = packHalf(vertex.pos.x);
+    packed.pos[1] = packHalf(vertex.pos.y);
+  }
+  else
+  {
+    packed.pos[0] = packSnorm16(vertex.pos.x);
+    packed.pos[1] = packSnorm16(vertex.pos.y);
+  }
+  packed.color[0] = packUnorm8(vertex.color.r);
+  packed.color[1] = packUnorm8(vertex.color.g);
+  packed.color[2] = packUnorm8(vertex.color.b);
+  packed.color[3] = 255;
+
+  return packed;
+}
+
+#ifdef __SSE2__
+// Packed positions of four vertices, one vertex in every 32-bit lane
+static __m128i packPositions4(const Vertex *vertices, VertexFormat format)
+{
+  __m128 xy01 = _mm_setr_ps(vertices[0].pos.x, vertices[0].pos.y,
+                            vertices[1].pos.x, vertices[1].pos.y);
+  __m128 xy23 = _mm_setr_ps(vertices[2].pos.x, vertices[2].pos.y,
+                            vertices[3].pos.x, vertices[3].pos.y);
+
+  if (format == VertexFormat::Snorm16)
+  {
+    const __m128 minusOne = _mm_set1_ps(-1.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    __m128i xy01Snorm = _mm_cvtps_epi32(
+        _mm_mul_ps(_mm_min_ps(_mm_max_ps(xy01, minusOne), one), scale));
+    __m128i xy23Snorm = _mm_cvtps_epi32(
+        _mm_mul_ps(_mm_min_ps(_mm_max_ps(xy23, minusOne), one), scale));
+
+    return _mm_packs_epi32(xy01Snorm, xy23Snorm);
+  }
+
+#ifdef __F16C__
+  return _mm_unpacklo_epi64(_mm_cvtps_ph(xy01, _MM_FROUND_TO_NEAREST_INT),
+                            _mm_cvtps_ph(xy23, _MM_FROUND_TO_NEAREST_INT));
+#else
+  return _mm_setr_epi16(
+      packHalf(vertices[0].pos.x), packHalf(vertices[0].pos.y),
+      packHalf(vertices[1].pos.x), packHalf(vertices[1].pos.y),
+      packHalf(vertices[2].pos.x), packHalf(vertices[2].pos.y),
+      packHalf(vertices[3].pos.x), packHalf(vertices[3].pos.y));
+#endif
+}
+
+// Packed colors of four vertices, one vertex in every 32-bit lane
+static __m128i packColors4(const Vertex *vertices)
+{
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 scale = _mm_set1_ps(255.0f);
+
+  __m128i rgba[4];
+  for (int i = 0; i < 4; i++)
+  {
+    __m128 color = _mm_setr_ps(vertices[i].color.r, vertices[i].color.g,
+                               vertices[i].color.b, 1.0f);
+    rgba[i] = _mm_cvtps_epi32(
+        _mm_mul_ps(_mm_min_ps(_mm_max_ps(color, zero), one), scale));
+  }
+
+  // The values are in [0, 255], so the saturating packs keep them as they are
+  return _mm_packus_epi16(_mm_packs_epi32(rgba[0], rgba[1]),
+                          _mm_packs_epi32(rgba[2], rgba[3]));
+}
+#endif
+
+std::vector<PackedVertex> packVertices(const std::vector<Vertex> &vertices,
+                                       VertexFormat format)
+{
+  if (format == VertexFormat::Float)
+    throw std::runtime_error("float vertices can not be packed!");
+
+  std::vector<PackedVertex> packed(vertices.size());
+  size_t i = 0;
+
+#ifdef __SSE2__
+  for (; i + 4 <= vertices.size(); i += 4)
+  {
+    __m128i positions = packPositions4(&vertices[i], format);
+    __m128i colors = packColors4(&vertices[i]);
+
+    // PackedVertex is the position followed by the color, so interleaving
+    // the lanes gives two vertices per 16 bytes
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(&packed[i]),
+                     _mm_unpacklo_epi32(positions, colors));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(&packed[i + 2]),
+                     _mm_unpackhi_epi32(positions, colors));
+  }
+#endif
+
+  for (; i < vertices.size(); i++)
+    packed[i] = packVertex(vertices[i], format);
+
+  return packed;
+}
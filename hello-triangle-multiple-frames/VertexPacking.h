@@ -0,0 +1,13 @@
+#pragma once
+#include "Shading.h"
+#include "VertexFormat.h"
+
+// Size of one vertex in the vertex buffer
+uint32_t vertexStride(VertexFormat format);
+
+// Quantize the vertices to PackedVertex. Four vertices are converted at a
+// time with SSE2 (and F16C for half floats) when the compiler targets them.
+// Positions outside [-1, 1] are clamped by the snorm16 format, colors are
+// clamped to [0, 1] and get an alpha of 1.
+std::vector<PackedVertex> packVertices(const std::vector<Vertex> &vertices,
+                                       VertexFormat format);
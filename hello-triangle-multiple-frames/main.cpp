@@ -2,10 +2,9 @@
 #include "HelloTriangleApplication.h"
 #include <GLFW/glfw3.h>
 
-int main() {
-  HelloTriangleApplication app;
-
+int main(int argc, char **argv) {
   try {
+    HelloTriangleApplication app(parseArguments(argc, argv));
     app.run();
   } catch (const std::exception &e) {
     std::cerr << e.what() << std::endl;
@@ -13,4 +12,4 @@ int main() {
   }
 
   return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
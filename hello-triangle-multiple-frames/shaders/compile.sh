@@ -1,2 +1,4 @@
 /usr/bin/glslc shader.vert -o vert.spv
 /usr/bin/glslc shader.frag -o frag.spv
+/usr/bin/glslc instanced.vert -o instanced_vert.spv
+/usr/bin/glslc cull.comp -o cull_comp.spv
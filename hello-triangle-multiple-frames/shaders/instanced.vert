@@ -0,0 +1,16 @@
+#version 450
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec4 instanceTransform;
+layout(location = 3) in vec3 instanceColor;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    float c = cos(instanceTransform.w);
+    float s = sin(instanceTransform.w);
+    vec2 position = mat2(c, s, -s, c) * inPosition * instanceTransform.z;
+    gl_Position = vec4(position + instanceTransform.xy, 0.0, 1.0);
+    fragColor = inColor * instanceColor;
+}